@@ -7,6 +7,9 @@
 //   control-u -- kill line
 //   control-d -- end of file
 //   control-p -- print process list
+// In raw mode (see consoleioctl()) none of these are
+// special, nothing is echoed, and reads return whatever
+// input has arrived.
 //
 
 #include <stdarg.h>
@@ -17,9 +20,11 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "file.h"
+#include "fcntl.h"
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
+#include "rusage.h"
 #include "proc.h"
 
 #define BACKSPACE 0x100
@@ -45,26 +50,33 @@ struct {
   struct spinlock lock;
   
   // input
-#define INPUT_BUF_SIZE 128
+#define INPUT_BUF_SIZE CONSBUF
   char buf[INPUT_BUF_SIZE];
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+  int raw; // Raw (non-canonical) input mode?
+  int rawpid; // Process that set raw mode
 } cons;
 
 //
 // user write()s to the console go here.
+// copy a chunk at a time, and hand each chunk
+// to the uart in one go.
 //
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
+  int i, m;
+  char buf[128];
 
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartwrite(buf, m);
   }
 
   return i;
@@ -85,6 +97,31 @@ consoleread(int user_dst, uint64 dst, int n)
 
   target = n;
   acquire(&cons.lock);
+  if(cons.raw){
+    // take whatever has arrived, without interpretation.
+    while(cons.r == cons.w){
+      if(killed(myproc())){
+        release(&cons.lock);
+        return -1;
+      }
+      sleep(&cons.r, &cons.lock);
+    }
+    while(n > 0 && cons.r != cons.w){
+      uint off = cons.r % INPUT_BUF_SIZE;
+      uint m = cons.w - cons.r;
+      if(m > INPUT_BUF_SIZE - off)
+        m = INPUT_BUF_SIZE - off;
+      if(m > n)
+        m = n;
+      if(either_copyout(user_dst, dst, &cons.buf[off], m) == -1)
+        break;
+      cons.r += m;
+      dst += m;
+      n -= m;
+    }
+    release(&cons.lock);
+    return target - n;
+  }
   while(n > 0){
     // wait until interrupt handler has put some
     // input into cons.buffer.
@@ -128,56 +165,125 @@ consoleread(int user_dst, uint64 dst, int n)
 
 //
 // the console input interrupt handler.
-// uartintr() calls this for input character.
+// uartintr() calls this with the input characters
+// it drained from the uart.
 // do erase/kill processing, append to cons.buf,
 // wake up consoleread() if a whole line has arrived.
 //
 void
-consoleintr(int c)
+consoleintr(char *s, int n)
 {
+  int c, i, wake = 0;
+
   acquire(&cons.lock);
 
-  switch(c){
-  case C('P'):  // Print process list.
-    procdump();
-    break;
-  case C('U'):  // Kill line.
-    while(cons.e != cons.w &&
-          cons.buf[(cons.e-1) % INPUT_BUF_SIZE] != '\n'){
-      cons.e--;
-      consputc(BACKSPACE);
-    }
-    break;
-  case C('H'): // Backspace
-  case '\x7f': // Delete key
-    if(cons.e != cons.w){
-      cons.e--;
-      consputc(BACKSPACE);
+  for(i = 0; i < n; i++){
+    c = s[i] & 0xff;
+
+    if(cons.raw){
+      // no editing, no echo; every byte is input.
+      if(cons.e-cons.r < INPUT_BUF_SIZE){
+        cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
+        cons.w = cons.e;
+        wake = 1;
+      }
+      continue;
     }
-    break;
-  default:
-    if(c != 0 && cons.e-cons.r < INPUT_BUF_SIZE){
-      c = (c == '\r') ? '\n' : c;
 
-      // echo back to the user.
-      consputc(c);
+    switch(c){
+    case C('P'):  // Print process list.
+      procdump();
+      break;
+    case C('U'):  // Kill line.
+      while(cons.e != cons.w &&
+            cons.buf[(cons.e-1) % INPUT_BUF_SIZE] != '\n'){
+        cons.e--;
+        consputc(BACKSPACE);
+      }
+      break;
+    case C('H'): // Backspace
+    case '\x7f': // Delete key
+      if(cons.e != cons.w){
+        cons.e--;
+        consputc(BACKSPACE);
+      }
+      break;
+    default:
+      if(c != 0 && cons.e-cons.r < INPUT_BUF_SIZE){
+        c = (c == '\r') ? '\n' : c;
 
-      // store for consumption by consoleread().
-      cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
+        // echo back to the user.
+        consputc(c);
 
-      if(c == '\n' || c == C('D') || cons.e-cons.r == INPUT_BUF_SIZE){
-        // wake up consoleread() if a whole line (or end-of-file)
-        // has arrived.
-        cons.w = cons.e;
-        wakeup(&cons.r);
+        // store for consumption by consoleread().
+        cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
+
+        if(c == '\n' || c == C('D') || cons.e-cons.r == INPUT_BUF_SIZE){
+          // wake up consoleread() if a whole line (or end-of-file)
+          // has arrived.
+          cons.w = cons.e;
+          wake = 1;
+        }
       }
+      break;
     }
-    break;
   }
+
+  if(wake)
+    wakeup(&cons.r);
   
   release(&cons.lock);
 }
 
+// caller must hold cons.lock.
+static void
+setraw(int raw)
+{
+  cons.raw = raw;
+  cons.rawpid = raw ? myproc()->pid : 0;
+  // whatever is being edited becomes input.
+  cons.w = cons.e;
+  wakeup(&cons.r);
+}
+
+//
+// ioctl()s on the console go here.
+//
+int
+consoleioctl(int req, int arg)
+{
+  int r;
+
+  switch(req){
+  case CONSOLE_SETRAW:
+    acquire(&cons.lock);
+    setraw(arg != 0);
+    release(&cons.lock);
+    return 0;
+  case CONSOLE_GETRAW:
+    acquire(&cons.lock);
+    r = cons.raw;
+    release(&cons.lock);
+    return r;
+  }
+  return -1;
+}
+
+//
+// process pid has closed a console file, or is exiting.
+// if it put the console in raw mode, go back to line
+// input, so that a program killed in raw mode doesn't
+// leave the shell without editing, echo or ^D.
+//
+void
+consolerelease(int pid)
+{
+  acquire(&cons.lock);
+  if(cons.raw && cons.rawpid == pid)
+    setraw(0);
+  release(&cons.lock);
+}
+
 void
 consoleinit(void)
 {
@@ -189,4 +295,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].ioctl = consoleioctl;
 }
@@ -0,0 +1,8 @@
+// per-CPU load, as returned by cpustat().
+// times are in units of the time CSR, TIMEBASE per second.
+struct cpustat {
+  int online;       // has this CPU started?
+  uint64 busy;      // time spent running processes
+  uint64 idle;      // time spent with nothing to run
+  uint64 nswtch;    // processes run
+};
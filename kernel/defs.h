@@ -1,7 +1,9 @@
 struct buf;
 struct context;
+struct fdtable;
 struct file;
 struct inode;
+struct kmem_cache;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -19,11 +21,15 @@ void            bunpin(struct buf*);
 
 // console.c
 void            consoleinit(void);
-void            consoleintr(int);
+void            consoleintr(char*, int);
 void            consputc(int);
+void            consolerelease(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
+int             execfault(pagetable_t, uint64, int);
+void            execprefault(uint64, uint64, int);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,6 +39,16 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             fileioctl(struct file*, int, int);
+struct fdtable* fdtalloc(void);
+struct fdtable* fdtcopy(struct fdtable*);
+struct fdtable* fdtshare(struct fdtable*);
+struct fdtable* fdtmap(struct fdtable*, int*, int);
+void            fdtput(struct fdtable*);
+int             fdalloc(struct proc*, struct file*);
+struct file*    fdget(struct proc*, int);
+void            fdput(struct proc*);
+struct file*    fdremove(struct proc*, int);
 
 // fs.c
 void            fsinit(int);
@@ -40,6 +56,8 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iexecdup(struct inode*);
+void            iexecput(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -63,6 +81,7 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+uint64          acquire_freemem(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -70,7 +89,16 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// pcache.c
+void            pcacheinit(void);
+uint64          pcache_get(struct inode*, uint);
+void            pcache_dup(uint64);
+void            pcache_put(uint64);
+void            pcache_inval(struct inode*);
+void            pcache_reap(void);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -80,15 +108,17 @@ int             pipewrite(struct pipe*, uint64, int);
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
+int             getcallerpcs(uint64, uint64*, int);
+void            backtrace(void);
 
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
-void            proc_mapstacks(pagetable_t);
+int             spawn(char*, char**, int*, int);
+uint64          growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+void            proc_freepagetable(pagetable_t, uint64, uint64);
 int             kill(int);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
@@ -98,10 +128,20 @@ struct proc*    myproc();
 void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+void            notestack(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
 void            wakeup(void*);
+void            wakeup1(void*);
+int             wakeupn(void*, int);
+int             futex(uint64, int, int);
+int             setaffinity(int, uint64);
+int             cpustat(uint64, int);
+int             getrusage(int, uint64);
+int             procstat(uint64, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -115,11 +155,18 @@ void            swtch(struct context*, struct context*);
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
+int             holdingany(void);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            kmem_cache_reap(void);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -143,17 +190,29 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// prof.c
+void            profinit(void);
+uint64          profinterval(void);
+void            profsample(uint64, int);
+int             prof(int, uint64, int);
+
+// timer.c
+void            timerqinit(void);
+void            clockarm(void);
+void            clockslice(void);
+int             clockintr(void);
+int             timersleep(uint64);
+
 // trap.c
-extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
 void            usertrapret(void);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartwrite(char*, int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
@@ -165,6 +224,7 @@ int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
+uint64          uvmlazy(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
@@ -3,12 +3,19 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
 
 static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
 
+int
+exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
+
 int flags2perm(int flags)
 {
     int perm = 0;
@@ -19,17 +26,26 @@ int flags2perm(int flags)
     return perm;
 }
 
+// Replace p's user memory with the program path, and set
+// its trapframe up to start main(argc, argv). p is either
+// the caller, or a child spawn() has not yet let run.
+// Returns argc, or -1 with p unchanged.
 int
-exec(char *path, char **argv)
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *oldip, *nip = 0;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+  struct seg segs[MAXSEG], *sg;
+  int nseg = 0;
+
+  // other threads are still running in this address space.
+  if(p->mm->ref > 1)
+    return -1;
 
   begin_op();
 
@@ -49,7 +65,10 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Map the program. Segments are left for execfault() to
+  // load when first touched, marked PTE_L; only if there are
+  // more than MAXSEG are the rest read in now.
+  uint64 sz1;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -59,27 +78,40 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
+    if(ph.off + ph.filesz < ph.off)
+      goto bad;
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < sz)
       goto bad;
-    uint64 sz1;
+    if(nseg < MAXSEG){
+      sg = &segs[nseg++];
+      sg->va = ph.vaddr;
+      sg->end = ph.vaddr + ph.memsz;
+      sg->fileend = ph.vaddr + ph.filesz;
+      sg->off = ph.off;
+      sg->perm = flags2perm(ph.flags);
+      if((sz1 = uvmlazy(pagetable, sz, sg->end)) == 0)
+        goto bad;
+      sz = sz1;
+      continue;
+    }
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
       goto bad;
     sz = sz1;
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
+  nip = iexecdup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
-  uint64 oldsz = p->sz;
+  uint64 oldsz = p->mm->sz;
+  uint64 oldtrapva = p->trapva;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible as a stack guard.
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
-  uint64 sz1;
   if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE, PTE_W)) == 0)
     goto bad;
   sz = sz1;
@@ -123,23 +155,151 @@ exec(char *path, char **argv)
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
-  p->sz = sz;
+  p->mm->sz = sz;
+  oldip = p->mm->ip;
+  p->mm->ip = nip;
+  p->mm->nseg = nseg;
+  memmove(p->mm->seg, segs, sizeof(segs));
+  p->ru.npage += 2;   // the stack; execfault() counts the rest
+  p->mm->tfslots = 1;
+  p->trapva = TRAPFRAME;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  p->thread = 0;   // a lone thread that execs is a process now
+  proc_freepagetable(oldpagetable, oldsz, oldtrapva);
+  if(oldip){
+    begin_op();
+    iexecput(oldip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
   if(pagetable)
-    proc_freepagetable(pagetable, sz);
+    proc_freepagetable(pagetable, sz, TRAPFRAME);
   if(ip){
     iunlockput(ip);
     end_op();
   }
+  if(nip){
+    begin_op();
+    iexecput(nip);
+    end_op();
+  }
   return -1;
 }
 
+// Find the segment of p's program holding va, or return 0.
+static struct seg*
+findseg(struct mm *mm, uint64 va)
+{
+  struct seg *s;
+
+  if(va >= mm->sz)
+    return 0;
+  for(s = mm->seg; s < &mm->seg[mm->nseg]; s++)
+    if(va >= s->va && va < s->end)
+      return s;
+  return 0;
+}
+
+// Load the page holding va of the current process's program,
+// which exec() left unmapped: from the page cache if it is
+// read-only and wholly from the file, else into a new private
+// page. perm is the access that faulted: PTE_R, PTE_W or PTE_X.
+// Returns 0 if va is now mapped for that access, or -1.
+// May sleep, so the caller must hold no spinlocks. Fails if
+// the caller holds a sleep lock, e.g. an inode's around a
+// readi() copyout: taking mm->ip's lock could then deadlock
+// on that same lock, or take two inode locks out of order.
+int
+execfault(pagetable_t pagetable, uint64 va, int perm)
+{
+  struct proc *p = myproc();
+  struct mm *mm;
+  struct seg *s;
+  pte_t *pte;
+  uint64 pa, n;
+  int flags, shared;
+
+  if(p == 0 || p->pagetable != pagetable || p->nsleeplock > 0)
+    return -1;
+  mm = p->mm;
+  va = PGROUNDDOWN(va);
+  if((s = findseg(mm, va)) == 0)
+    return -1;
+  flags = PTE_R | PTE_U | s->perm;
+  if((flags & perm) != perm)
+    return -1;   // e.g. a store to text
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return 0;    // another thread loaded it first
+
+  shared = (s->perm & PTE_W) == 0 && va + PGSIZE <= s->fileend;
+  if(shared){
+    if((pa = pcache_get(mm->ip, s->off + (va - s->va))) == 0)
+      return -1;
+    flags |= PTE_S;
+  } else {
+    if((pa = (uint64)kalloc()) == 0)
+      return -1;
+    memset((void*)pa, 0, PGSIZE);
+    if(va < s->fileend){
+      n = s->fileend - va;
+      if(n > PGSIZE)
+        n = PGSIZE;
+      ilock(mm->ip);
+      if(readi(mm->ip, 0, pa, s->off + (va - s->va), n) != n){
+        iunlock(mm->ip);
+        kfree((void*)pa);
+        return -1;
+      }
+      iunlock(mm->ip);
+    }
+  }
+
+  acquire(&mm->lock);
+  if(((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V)) ||
+     mappages(pagetable, va, PGSIZE, pa, flags) != 0){
+    // another thread loaded it meanwhile, or out of memory.
+    release(&mm->lock);
+    if(shared)
+      pcache_put(pa);
+    else
+      kfree((void*)pa);
+    return (pte && (*pte & PTE_V)) ? 0 : -1;
+  }
+  release(&mm->lock);
+
+  p->ru.nfault++;
+  if(!shared)
+    p->ru.npage++;
+  return 0;
+}
+
+// Load any unloaded program pages in [va, va+n) ahead of a
+// read() or write() that will copy to or from them, since the
+// copy may be done holding a spinlock or an inode lock, when
+// execfault() cannot be called.
+void
+execprefault(uint64 va, uint64 n, int perm)
+{
+  struct proc *p = myproc();
+  struct mm *mm = p->mm;
+  struct seg *s;
+  uint64 a, end;
+
+  if(va + n < va)
+    return;
+  for(s = mm->seg; s < &mm->seg[mm->nseg]; s++){
+    a = va > s->va ? PGROUNDDOWN(va) : s->va;
+    end = va + n < s->end ? va + n : s->end;
+    for(; a < end; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0)
+        execfault(p->pagetable, a, perm);
+  }
+}
+
 // Load a program segment into pagetable at virtual address va.
 // va must be page-aligned
 // and the pages from va to va+sz must already be mapped.
@@ -3,3 +3,7 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// ioctl() requests
+#define CONSOLE_SETRAW 1  // console: arg!=0 raw input, arg==0 line input
+#define CONSOLE_GETRAW 2  // console: returns 1 if input is raw, else 0
@@ -11,18 +11,28 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "rusage.h"
 #include "proc.h"
+#include "slab.h"
 
 struct devsw devsw[NDEV];
+
+// open files come from a slab cache, so the number of
+// them is limited only by memory. ftable.lock protects
+// every file's ref count.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache cache;
 } ftable;
 
+struct kmem_cache fdtcache;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmem_cache_init(&ftable.cache, "file", sizeof(struct file));
+  kmem_cache_init(&fdtcache, "fdtable", sizeof(struct fdtable));
 }
 
 // Allocate a file structure.
@@ -31,16 +41,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,6 +77,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -82,6 +88,206 @@ fileclose(struct file *f)
   }
 }
 
+// Allocate an empty descriptor table.
+struct fdtable*
+fdtalloc(void)
+{
+  struct fdtable *t;
+
+  if((t = kmem_cache_alloc(&fdtcache)) == 0)
+    return 0;
+  memset(t, 0, sizeof(*t));
+  initlock(&t->lock, "fdtable");
+  t->ref = 1;
+  t->nofile = NOFILE;
+  t->ofile = t->ofile0;
+  return t;
+}
+
+// Make room for more open files in t, by moving
+// its descriptors from t->ofile0 to a page of their own.
+// Caller must hold t->lock.
+// Returns 0, or -1 if the table cannot grow.
+static int
+fdgrow(struct fdtable *t)
+{
+  struct file **ofile;
+
+  if(t->nofile >= MAXOFILE || (ofile = (struct file**)kalloc()) == 0)
+    return -1;
+  memset(ofile, 0, PGSIZE);
+  memmove(ofile, t->ofile, t->nofile * sizeof(struct file*));
+  t->ofile = ofile;
+  t->nofile = MAXOFILE;
+  return 0;
+}
+
+// Copy descriptor table t for fork().
+struct fdtable*
+fdtcopy(struct fdtable *t)
+{
+  struct fdtable *nt;
+  int fd;
+
+  if((nt = fdtalloc()) == 0)
+    return 0;
+  acquire(&t->lock);
+  if(t->nofile > nt->nofile && fdgrow(nt) < 0){
+    release(&t->lock);
+    fdtput(nt);
+    return 0;
+  }
+  for(fd = 0; fd < t->nofile; fd++)
+    if(t->ofile[fd])
+      nt->ofile[fd] = filedup(t->ofile[fd]);
+  nt->fdhint = t->fdhint;
+  release(&t->lock);
+  return nt;
+}
+
+// Make a descriptor table for spawn(), whose descriptor i
+// refers to the file of t's descriptor map[i], or is closed
+// if map[i] is -1. n must be at most NOFILE.
+// Returns 0 if some map[i] is not open in t.
+struct fdtable*
+fdtmap(struct fdtable *t, int *map, int n)
+{
+  struct fdtable *nt;
+  int fd;
+
+  if((nt = fdtalloc()) == 0)
+    return 0;
+  acquire(&t->lock);
+  for(fd = 0; fd < n; fd++){
+    if(map[fd] == -1)
+      continue;
+    if(map[fd] < 0 || map[fd] >= t->nofile || t->ofile[map[fd]] == 0){
+      release(&t->lock);
+      fdtput(nt);
+      return 0;
+    }
+    nt->ofile[fd] = filedup(t->ofile[map[fd]]);
+  }
+  release(&t->lock);
+  return nt;
+}
+
+// Share descriptor table t with a new thread.
+struct fdtable*
+fdtshare(struct fdtable *t)
+{
+  acquire(&t->lock);
+  t->ref++;
+  release(&t->lock);
+  return t;
+}
+
+// Drop a reference to t. The last one closes
+// every file in it.
+void
+fdtput(struct fdtable *t)
+{
+  int fd;
+
+  acquire(&t->lock);
+  if(--t->ref > 0){
+    release(&t->lock);
+    return;
+  }
+  release(&t->lock);
+
+  for(fd = 0; fd < t->nofile; fd++){
+    if(t->ofile[fd]){
+      fileclose(t->ofile[fd]);
+      t->ofile[fd] = 0;
+    }
+  }
+  if(t->ofile != t->ofile0)
+    kfree((void*)t->ofile);
+  kmem_cache_free(&fdtcache, t);
+}
+
+// Give f a descriptor in p's table.
+// Takes over the caller's reference to f on success.
+// Returns the lowest free descriptor, or -1.
+int
+fdalloc(struct proc *p, struct file *f)
+{
+  struct fdtable *t = p->fdt;
+  int fd;
+
+  acquire(&t->lock);
+  for(fd = t->fdhint; ; fd++){
+    if(fd >= t->nofile && fdgrow(t) < 0){
+      release(&t->lock);
+      return -1;
+    }
+    if(t->ofile[fd] == 0){
+      t->ofile[fd] = f;
+      t->fdhint = fd + 1;
+      release(&t->lock);
+      return fd;
+    }
+  }
+}
+
+// Look up descriptor fd in p's table. Returns 0 if fd
+// is not open. If other threads share the table, one of
+// them might close fd while p uses the file, so take a
+// reference that fdput() drops when the system call ends.
+struct file*
+fdget(struct proc *p, int fd)
+{
+  struct fdtable *t = p->fdt;
+  struct file *f;
+
+  // only p could add a sharer, so if there
+  // are none now there will be none for the
+  // rest of this system call.
+  if(t->ref == 1)
+    return (fd < 0 || fd >= t->nofile) ? 0 : t->ofile[fd];
+
+  acquire(&t->lock);
+  f = (fd < 0 || fd >= t->nofile) ? 0 : t->ofile[fd];
+  if(f){
+    if(p->fdref)
+      panic("fdget");
+    p->fdref = filedup(f);
+  }
+  release(&t->lock);
+  return f;
+}
+
+// Drop the reference fdget() took, if any.
+void
+fdput(struct proc *p)
+{
+  if(p->fdref){
+    fileclose(p->fdref);
+    p->fdref = 0;
+  }
+}
+
+// Remove descriptor fd from p's table, and return the
+// file it referred to, or 0 if it was not open.
+// The caller takes over the table's reference.
+struct file*
+fdremove(struct proc *p, int fd)
+{
+  struct fdtable *t = p->fdt;
+  struct file *f;
+
+  acquire(&t->lock);
+  f = (fd < 0 || fd >= t->nofile) ? 0 : t->ofile[fd];
+  if(f){
+    t->ofile[fd] = 0;
+    if(fd < t->fdhint)
+      t->fdhint = fd;
+  }
+  release(&t->lock);
+  return f;
+}
+
 // Get metadata about file f.
 // addr is a user virtual address, pointing to a struct stat.
 int
@@ -180,3 +386,14 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Device-specific control operation on file f.
+int
+fileioctl(struct file *f, int req, int arg)
+{
+  if(f->type != FD_DEVICE)
+    return -1;
+  if(f->major < 0 || f->major >= NDEV || !devsw[f->major].ioctl)
+    return -1;
+  return devsw[f->major].ioctl(req, arg);
+}
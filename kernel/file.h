@@ -9,6 +9,17 @@ struct file {
   short major;       // FD_DEVICE
 };
 
+// a process's file descriptors. threads made by
+// clone() share one.
+struct fdtable {
+  struct spinlock lock;   // protects everything below
+  int ref;                // processes using this table
+  int nofile;             // number of slots in ofile
+  int fdhint;             // every fd below this is in use
+  struct file **ofile;    // ofile0, or a page of MAXOFILE
+  struct file *ofile0[NOFILE];
+};
+
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
@@ -18,6 +29,7 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nexec;          // mms running it; protected by itable.lock
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -33,6 +45,7 @@ struct inode {
 struct devsw {
   int (*read)(int, uint64, int);
   int (*write)(int, uint64, int);
+  int (*ioctl)(int, int);
 };
 
 extern struct devsw devsw[];
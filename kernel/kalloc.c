@@ -1,12 +1,13 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and slab pages (see slab.c). Allocates whole 4096-byte pages.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "usyscall.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -23,13 +24,21 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  uint64 nfree;           // pages on freelist
 } kmem;
 
+// counters that every process can read; see usyscall.h.
+struct kinfo *kinfo;
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
   freerange(end, (void*)PHYSTOP);
+  if((kinfo = kalloc()) == 0)
+    panic("kinit");
+  memset(kinfo, 0, PGSIZE);
+  kinfo->freemem = kmem.nfree * PGSIZE;
 }
 
 void
@@ -61,6 +70,9 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
+  if(kinfo)
+    kinfo->freemem = kmem.nfree * PGSIZE;
   release(&kmem.lock);
 }
 
@@ -74,8 +86,21 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r == 0){
+    // out of pages; the program text cache and the slab
+    // caches may be holding some that they no longer need.
+    release(&kmem.lock);
+    pcache_reap();
+    kmem_cache_reap();
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+  }
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+    if(kinfo)
+      kinfo->freemem = kmem.nfree * PGSIZE;
+  }
   release(&kmem.lock);
 
   if(r)
@@ -83,24 +108,14 @@ kalloc(void)
   return (void*)r;
 }
 
-
-// collect the amount of free memory 
-// 链表长度 * 4k 即为剩余空间
-uint64 acquire_freemem()
+// the amount of free memory, in bytes.
+uint64
+acquire_freemem()
 {
-
-  uint64 freemem = 0;
-  struct run *r;
+  uint64 n;
 
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  while(r)
-  {
-    r = r->next;
-    freemem++;
-  }
+  n = kmem.nfree;
   release(&kmem.lock);
-  return freemem * PGSIZE;
-
+  return n * PGSIZE;
 }
-
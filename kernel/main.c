@@ -27,6 +27,9 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    pcacheinit();    // program text page cache
+    profinit();      // sampling profiler
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -27,6 +27,7 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // software interrupt
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
@@ -62,6 +63,12 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   KINFO (read-only kernel counters, shared by all)
+//   USYSCALL (read-only facts about this address space)
+//   trapframes of threads sharing the address space
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define TRAPFRAMES (TRAPFRAME - (MAXTHREAD-1)*PGSIZE) // lowest of them
+#define USYSCALL (TRAPFRAMES - PGSIZE)
+#define KINFO (USYSCALL - PGSIZE)
@@ -1,7 +1,8 @@
-#define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
+#define NOFILE       16  // open files per process, before fdgrow()
+#define MAXOFILE    512  // open files per process: a page of pointers
+#define MAXSEG       4  // lazily loaded segments per program
+#define MAXTHREAD    64  // max threads sharing an address space
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
@@ -9,5 +10,10 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define FSSIZE       3000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define CONSBUF      1024  // console input buffer size (bytes)
+#define TIMEBASE     10000000  // time CSR ticks per second (qemu virt)
+#define TICKINTERVAL 1000000   // time CSR ticks per clock tick (1/10th second)
+#define QUANTUM      TICKINTERVAL  // scheduling time slice
+#define PROFTICK     (TIMEBASE/1000)  // default profiler sampling interval
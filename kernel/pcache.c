@@ -0,0 +1,256 @@
+// Cache of program text pages, shared read-only between
+// all the processes running the same binary.
+//
+// exec() leaves a program's segments unmapped, and
+// execfault() in exec.c loads each page on first touch.
+// A page lying wholly inside a read-only segment comes from
+// here: pages are keyed by (device, inode number, offset),
+// and are mapped with PTE_S, so that fork() shares them and
+// uvmunmap() gives them back with pcache_put() rather than
+// kfree().
+//
+// A page that no process maps stays cached, so the next run
+// of the program reads nothing from disk; kalloc() calls
+// pcache_reap() to free such pages when memory runs out.
+// Writing or truncating a file drops its pages from the
+// cache, though processes that map them keep them until
+// they unmap them.
+//
+// Lock order: pcache.lock, then the kalloc and slab locks.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "slab.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+#define NPCHASH 61
+
+struct ppage {
+  uint dev;
+  uint inum;
+  uint off;               // file offset, page-aligned
+  uint64 pa;              // the page
+  int ref;                // page table entries that map it
+  int valid;              // 1 once read, -1 if the read failed
+  int stale;              // dropped by pcache_inval()
+  struct ppage *knext;    // next in key hash chain, unless stale
+  struct ppage *pnext;    // next in pa hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache;
+  struct ppage *key[NPCHASH];   // hashed by dev and inum
+  struct ppage *pa[NPCHASH];    // hashed by pa
+} pcache;
+
+static int
+khash(uint dev, uint inum)
+{
+  return (dev * 31 + inum) % NPCHASH;
+}
+
+static int
+pahash(uint64 pa)
+{
+  return (pa / PGSIZE) % NPCHASH;
+}
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  kmem_cache_init(&pcache.cache, "ppage", sizeof(struct ppage));
+}
+
+static struct ppage*
+pafind(uint64 pa)
+{
+  struct ppage *pp;
+
+  for(pp = pcache.pa[pahash(pa)]; pp; pp = pp->pnext)
+    if(pp->pa == pa)
+      return pp;
+  panic("pcache: no page");
+}
+
+static void
+ppunlink(struct ppage **head, struct ppage *pp, int key)
+{
+  struct ppage **l;
+
+  for(l = head; *l; l = key ? &(*l)->knext : &(*l)->pnext){
+    if(*l == pp){
+      *l = key ? pp->knext : pp->pnext;
+      return;
+    }
+  }
+  panic("pcache: unlink");
+}
+
+// Free a page nothing maps.
+// Caller must hold pcache.lock.
+static void
+ppfree(struct ppage *pp)
+{
+  if(!pp->stale)
+    ppunlink(&pcache.key[khash(pp->dev, pp->inum)], pp, 1);
+  ppunlink(&pcache.pa[pahash(pp->pa)], pp, 0);
+  kfree((void*)pp->pa);
+  kmem_cache_free(&pcache.cache, pp);
+}
+
+// Return the physical address of the page at file offset off
+// of ip, reading it if it is not cached, with a reference for
+// the caller's mapping. Returns 0 if out of memory, or if the
+// file does not have a whole page at off.
+// ip must not be locked.
+uint64
+pcache_get(struct inode *ip, uint off)
+{
+  struct ppage *pp, *np = 0;
+  char *mem = 0;
+  int h = khash(ip->dev, ip->inum), n;
+
+  acquire(&pcache.lock);
+  for(;;){
+    for(pp = pcache.key[h]; pp; pp = pp->knext)
+      if(pp->dev == ip->dev && pp->inum == ip->inum && pp->off == off)
+        break;
+    if(pp){
+      pp->ref++;
+      while(pp->valid == 0)
+        sleep(pp, &pcache.lock);   // another process is reading it
+      if(pp->valid < 0){
+        if(--pp->ref == 0)
+          ppfree(pp);
+        release(&pcache.lock);
+        return 0;
+      }
+      release(&pcache.lock);
+      if(np){
+        kmem_cache_free(&pcache.cache, np);
+        kfree(mem);
+      }
+      return pp->pa;
+    }
+    if(np)
+      break;
+
+    // kalloc() may call pcache_reap(), so allocate
+    // without the lock, then look again.
+    release(&pcache.lock);
+    np = kmem_cache_alloc(&pcache.cache);
+    mem = kalloc();
+    if(np == 0 || mem == 0){
+      if(np)
+        kmem_cache_free(&pcache.cache, np);
+      if(mem)
+        kfree(mem);
+      return 0;
+    }
+    acquire(&pcache.lock);
+  }
+
+  np->dev = ip->dev;
+  np->inum = ip->inum;
+  np->off = off;
+  np->pa = (uint64)mem;
+  np->ref = 1;
+  np->valid = 0;
+  np->stale = 0;
+  np->knext = pcache.key[h];
+  pcache.key[h] = np;
+  np->pnext = pcache.pa[pahash(np->pa)];
+  pcache.pa[pahash(np->pa)] = np;
+  release(&pcache.lock);
+
+  ilock(ip);
+  n = readi(ip, 0, (uint64)mem, off, PGSIZE);
+  iunlock(ip);
+
+  acquire(&pcache.lock);
+  np->valid = (n == PGSIZE) ? 1 : -1;
+  wakeup(np);
+  if(np->valid < 0){
+    if(--np->ref == 0)
+      ppfree(np);
+    release(&pcache.lock);
+    return 0;
+  }
+  release(&pcache.lock);
+  return (uint64)mem;
+}
+
+// Another page table maps pa, a page from pcache_get().
+void
+pcache_dup(uint64 pa)
+{
+  acquire(&pcache.lock);
+  pafind(pa)->ref++;
+  release(&pcache.lock);
+}
+
+// A page table no longer maps pa, a page from pcache_get().
+void
+pcache_put(uint64 pa)
+{
+  struct ppage *pp;
+
+  acquire(&pcache.lock);
+  pp = pafind(pa);
+  if(--pp->ref == 0 && pp->stale)
+    ppfree(pp);
+  release(&pcache.lock);
+}
+
+// ip's contents have changed; stop handing out its pages.
+// Called with ip locked, by writei() and itrunc().
+void
+pcache_inval(struct inode *ip)
+{
+  struct ppage **l, *pp;
+  int h = khash(ip->dev, ip->inum);
+
+  // most files are not programs anyone has run.
+  if(pcache.key[h] == 0)
+    return;
+
+  acquire(&pcache.lock);
+  for(l = &pcache.key[h]; (pp = *l) != 0; ){
+    if(pp->dev != ip->dev || pp->inum != ip->inum){
+      l = &pp->knext;
+      continue;
+    }
+    *l = pp->knext;
+    pp->stale = 1;
+    if(pp->ref == 0)
+      ppfree(pp);
+  }
+  release(&pcache.lock);
+}
+
+// Free every cached page that no process maps.
+// Must not be called with pcache.lock held.
+void
+pcache_reap(void)
+{
+  struct ppage *pp, *next;
+  int h;
+
+  acquire(&pcache.lock);
+  for(h = 0; h < NPCHASH; h++){
+    for(pp = pcache.key[h]; pp; pp = next){
+      next = pp->knext;
+      if(pp->ref == 0)
+        ppfree(pp);
+    }
+  }
+  release(&pcache.lock);
+}
@@ -13,6 +13,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
+#include "rusage.h"
 #include "proc.h"
 
 volatile int panicked = 0;
@@ -122,11 +123,47 @@ panic(char *s)
   printf("panic: ");
   printf(s);
   printf("\n");
+  backtrace();
   panicked = 1; // freeze uart output from other CPUs
   for(;;)
     ;
 }
 
+// Put up to n return addresses from the kernel stack in pcs,
+// starting with the frame whose frame pointer is fp; returns
+// how many. The kernel is compiled with frame pointers, so a
+// frame holds its return address at fp-8 and its caller's fp
+// at fp-16. Every kernel stack is one page, so the walk stops
+// at the top of the page fp is in.
+int
+getcallerpcs(uint64 fp, uint64 *pcs, int n)
+{
+  uint64 bottom = PGROUNDDOWN(fp - 1), top = bottom + PGSIZE;
+  int i;
+
+  for(i = 0; i < n && fp >= bottom + 16 && fp <= top; i++){
+    pcs[i] = *(uint64*)(fp - 8);
+    if(*(uint64*)(fp - 16) <= fp)
+      return i + 1;
+    fp = *(uint64*)(fp - 16);
+  }
+  return i;
+}
+
+// print the return addresses on this kernel stack;
+// addr2line -e kernel/kernel turns them into lines.
+void
+backtrace(void)
+{
+  uint64 pcs[32];
+  int i, n;
+
+  n = getcallerpcs(r_fp(), pcs, NELEM(pcs));
+  printf("backtrace:\n");
+  for(i = 0; i < n; i++)
+    printf("%p\n", pcs[i]);
+}
+
 void
 printfinit(void)
 {
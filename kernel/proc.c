@@ -3,59 +3,254 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "slab.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
+#include "futex.h"
+#include "cpustat.h"
+#include "usyscall.h"
 
 struct cpu cpus[NCPU];
-// process pool
-struct proc proc[NPROC];
+
+// The process table: proc structures come from a slab cache
+// and go back to it when reaped by wait(), so the number of
+// processes is limited by memory, and by a cap set at boot
+// from the amount of free memory.
+// lock order: p->lock, then ptable.lock.
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache;
+  struct kmem_cache mmcache;
+  struct proc *all;     // every allocated proc, through allnext
+  int nproc;            // number of allocated procs
+  int maxproc;
+} ptable;
+
+// about the least memory a process needs: kernel stack,
+// trapframe, page-table pages, and a few user pages.
+#define PROCPAGES 8
+
+// Kernel stacks, one page each at KSTACK(i) in the kernel
+// page table, with an unmapped guard page below, so that
+// an overflow faults rather than running into another page.
+// A slot keeps its mapping and its page once used: freeproc()
+// puts it on kstacks.free for the next allocproc(), so stacks
+// are never unmapped and no TLB shootdown is needed. Mapping
+// a new slot only turns an invalid PTE valid, but a hart may
+// have cached the invalid one; see kstackfence().
+// There are never more than ptable.maxproc slots.
+struct {
+  struct spinlock lock;
+  uint64 free;      // free slots, linked through their first word
+  int n;            // slots mapped so far
+} kstacks;
+
+// RUNNABLE processes, one queue per CPU, in the order they
+// became runnable, through rnext. a process is queued on the
+// CPU it last ran on if its affinity allows, so it keeps a
+// warm cache; a CPU with nothing of its own to run takes
+// work from the other queues.
+// lock order: p->lock, then a run queue's lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc **tail;
+} runq[NCPU];
+
+// CPUs that have entered the scheduler.
+uint64 cpuonline;
+
+// CPUs waiting in wfi for something to run; see scheduler().
+uint64 idlecpus;
 
 struct proc *initproc;
 
 int nextpid = 1;
+
+// pid_lock protects nextpid and pidhash, which finds
+// a process by pid without scanning the process table.
+// a proc is not freed while it is in pidhash, so holding
+// pid_lock keeps any proc found through it, or through
+// p->parent, from going away.
+// lock order: pid_lock, then p->wait_lock, then p->lock.
 struct spinlock pid_lock;
+#define NPIDHASH 64
+struct proc *pidhash[NPIDHASH];
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
-
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
-
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl)
+extern pagetable_t kernel_pagetable; // vm.c
+extern struct kinfo *kinfo; // kalloc.c
+
+// sleeping processes, hashed by the channel they sleep on,
+// so that wakeup() only looks at processes that might be
+// sleeping on its channel. each queue is in the order its
+// processes went to sleep, so wakeup1() wakes the one that
+// has waited longest.
+// lock order: the sleep() caller's lock, then a sleep queue's
+// lock, then p->lock.
+#define NSLEEPQ 61
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc **tail;   // last qnext link, or &head
+} sleepq[NSLEEPQ];
+
+static struct sleepq*
+chanq(void *chan)
 {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
+  return &sleepq[((uint64)chan >> 3) % NSLEEPQ];
 }
 
+// locks for futex(), one per sleep queue.
+// lock order: futex lock, then sleep queue lock.
+struct spinlock futexlock[NSLEEPQ];
+
 // initialize the proc table.
 void
 procinit(void)
 {
-  struct proc *p;
-  
   initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
+  for(int i = 0; i < NSLEEPQ; i++){
+    initlock(&sleepq[i].lock, "sleepq");
+    sleepq[i].tail = &sleepq[i].head;
+    initlock(&futexlock[i], "futex");
+  }
+  initlock(&ptable.lock, "ptable");
+  initlock(&kstacks.lock, "kstacks");
+  kmem_cache_init(&ptable.cache, "proc", sizeof(struct proc));
+  kmem_cache_init(&ptable.mmcache, "mm", sizeof(struct mm));
+  ptable.maxproc = acquire_freemem() / (PROCPAGES * PGSIZE);
+  for(int i = 0; i < NCPU; i++){
+    initlock(&runq[i].lock, "runq");
+    runq[i].tail = &runq[i].head;
+  }
+}
+
+// Choose the CPU whose run queue p should join:
+// the one it last ran on if allowed, else the first
+// allowed one. Caller must hold p->lock.
+static int
+pickcpu(struct proc *p)
+{
+  uint64 mask = p->affinity & cpuonline;
+  int id;
+
+  if(p->cpu >= 0 && (mask & (1UL << p->cpu)))
+    return p->cpu;
+  if(mask == 0)
+    return p->cpu >= 0 ? p->cpu : 0;   // still booting
+  for(id = 0; (mask & (1UL << id)) == 0; id++)
+    ;
+  return id;
+}
+
+// A process that may run on the CPUs in mask has just been
+// queued on CPU id. If id is idle, interrupt it out of wfi;
+// if it is busy, wake an idle CPU that can take the process.
+static void
+kick(int id, uint64 mask)
+{
+  uint64 idle;
+
+  // pairs with the barrier in scheduler() between setting
+  // a bit in idlecpus and looking at the run queues.
+  __sync_synchronize();
+  if((idle = idlecpus & mask) == 0)
+    return;
+  if((idle & (1UL << id)) == 0)
+    for(id = 0; (idle & (1UL << id)) == 0; id++)
+      ;
+  *(uint32*)CLINT_MSIP(id) = 1;
+}
+
+// Mark p RUNNABLE and queue it for the scheduler.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  int id = pickcpu(p);
+  struct runq *q = &runq[id];
+
+  p->state = RUNNABLE;
+  acquire(&q->lock);
+  p->rnext = 0;
+  *q->tail = p;
+  q->tail = &p->rnext;
+  release(&q->lock);
+  kick(id, p->affinity);
+}
+
+// Take the first process in q that may run on CPU id,
+// or return 0.
+static struct proc*
+runq_pop(struct runq *q, int id)
+{
+  struct proc *p, **pp;
+
+  if(q->head == 0)
+    return 0;   // don't bother locking an empty queue
+  acquire(&q->lock);
+  for(pp = &q->head; (p = *pp) != 0; pp = &p->rnext){
+    // p->lock is not held, so a concurrent setaffinity()
+    // can at worst let p run one time slice on a CPU it
+    // has just been moved off.
+    if(p->affinity & (1UL << id)){
+      *pp = p->rnext;
+      if(*pp == 0)
+        q->tail = pp;
+      p->rnext = 0;
+      break;
+    }
+  }
+  release(&q->lock);
+  return p;
+}
+
+// Take p off whichever run queue it is on. Returns 0 if
+// it is on none, because a scheduler has just taken it.
+// Caller must hold p->lock.
+static int
+runq_remove(struct proc *p)
+{
+  struct proc **pp;
+  int i;
+
+  for(i = 0; i < NCPU; i++){
+    acquire(&runq[i].lock);
+    for(pp = &runq[i].head; *pp != 0; pp = &(*pp)->rnext){
+      if(*pp == p){
+        *pp = p->rnext;
+        if(*pp == 0)
+          runq[i].tail = pp;
+        p->rnext = 0;
+        release(&runq[i].lock);
+        return 1;
+      }
+    }
+    release(&runq[i].lock);
   }
+  return 0;
+}
+
+// Take the next process for CPU id to run: from its
+// own run queue, or failing that from another CPU's.
+// Returns 0 if there is nothing to run.
+// A RUNNABLE process does not exit, so the caller may
+// safely acquire its lock.
+static struct proc*
+runq_take(int id)
+{
+  struct proc *p;
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    if((p = runq_pop(&runq[(id + i) % NCPU], id)) != 0)
+      return p;
+  return 0;
 }
 
 // Must be called with interrupts disabled,
@@ -89,54 +284,137 @@ myproc(void)
   return p;
 }
 
+// Give p a new pid, and enter it in pidhash.
 int
-allocpid()
+allocpid(struct proc *p)
 {
   int pid;
+  struct proc **h;
   
   acquire(&pid_lock);
   pid = nextpid;
   nextpid = nextpid + 1;
+  p->pid = pid;
+  h = &pidhash[pid % NPIDHASH];
+  p->pidnext = *h;
+  *h = p;
   release(&pid_lock);
 
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
+// Remove p from pidhash.
+static void
+freepid(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  p->pidnext = 0;
+  p->pid = 0;
+  release(&pid_lock);
+}
+
+// Flush this hart's TLB if kernel stacks have been mapped
+// since it last did. Interrupts must be disabled.
+static void
+kstackfence(void)
+{
+  struct cpu *c = mycpu();
+  int n = kstacks.n;
+
+  if(c->kstackseen != n){
+    sfence_vma();
+    c->kstackseen = n;
+  }
+}
+
+// Take a kernel stack, mapping a new slot if none is free.
+// Returns the stack's lowest address, or 0 if out of memory.
+static uint64
+kstackalloc(void)
+{
+  uint64 va;
+  char *pa;
+
+  acquire(&kstacks.lock);
+  kstackfence();
+  if((va = kstacks.free) != 0){
+    kstacks.free = *(uint64*)va;
+    release(&kstacks.lock);
+    return va;
+  }
+  release(&kstacks.lock);
+
+  // kalloc() may reap the slab caches; don't hold a lock.
+  if((pa = kalloc()) == 0)
+    return 0;
+  acquire(&kstacks.lock);
+  va = KSTACK(kstacks.n);
+  if(mappages(kernel_pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W) < 0){
+    release(&kstacks.lock);
+    kfree(pa);
+    return 0;
+  }
+  kstacks.n++;
+  release(&kstacks.lock);
+  return va;
+}
+
+static void
+kstackfree(uint64 va)
+{
+  acquire(&kstacks.lock);
+  kstackfence();
+  *(uint64*)va = kstacks.free;
+  kstacks.free = va;
+  release(&kstacks.lock);
+}
+
+// Allocate a proc and enter it in the process table.
+// If successful, initialize state required to run in the kernel,
 // and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// If there are too many procs, or a memory allocation fails, return 0.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  acquire(&ptable.lock);
+  if(ptable.nproc >= ptable.maxproc ||
+     (p = kmem_cache_alloc(&ptable.cache)) == 0){
+    release(&ptable.lock);
+    return 0;
   }
-  return 0;
-
-found:
-  p->pid = allocpid();
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  initlock(&p->wait_lock, "wait_lock");
   p->state = USED;
+  p->cpu = -1;
+  p->affinity = ~0UL;
+  p->allnext = ptable.all;
+  if(ptable.all)
+    ptable.all->allprev = &p->allnext;
+  p->allprev = &ptable.all;
+  ptable.all = p;
+  ptable.nproc++;
+  kinfo->nproc = ptable.nproc;
+  release(&ptable.lock);
+
+  allocpid(p);
+  acquire(&p->lock);
 
-  // Allocate a trapframe page.
-  if((p->trapframe = (struct trapframe *)kalloc()) == 0){
-    freeproc(p);
+  // Allocate a kernel stack page, and a trapframe page.
+  if((p->kstack = kstackalloc()) == 0 ||
+     (p->trapframe = (struct trapframe *)kalloc()) == 0){
     release(&p->lock);
-    return 0;
-  }
-
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
     freeproc(p);
-    release(&p->lock);
     return 0;
   }
 
@@ -149,27 +427,128 @@ found:
   return p;
 }
 
+// Give p a new address space, with no user memory,
+// and with p's trapframe in the first slot.
+// Returns 0, or -1 if out of memory.
+static int
+mmalloc(struct proc *p)
+{
+  struct mm *mm;
+
+  if((mm = kmem_cache_alloc(&ptable.mmcache)) == 0)
+    return -1;
+  initlock(&mm->lock, "mm");
+  mm->ref = 1;
+  mm->dying = 0;
+  mm->sz = 0;
+  mm->tfslots = 1;
+  mm->ip = 0;
+  mm->nseg = 0;
+  p->trapva = TRAPFRAME;
+  if((p->pagetable = proc_pagetable(p)) == 0){
+    kmem_cache_free(&ptable.mmcache, mm);
+    return -1;
+  }
+  p->mm = mm;
+  return 0;
+}
+
+// Let np share p's address space, with np's
+// trapframe mapped in a free slot.
+// Returns 0, or -1 if there are too many threads, or
+// the main thread is exiting.
+static int
+mmshare(struct proc *p, struct proc *np)
+{
+  struct mm *mm = p->mm;
+  uint64 va;
+  int i;
+
+  acquire(&mm->lock);
+  for(i = 0; i < MAXTHREAD; i++)
+    if((mm->tfslots & (1L << i)) == 0)
+      break;
+  va = TRAPFRAME - i*PGSIZE;
+  if(i == MAXTHREAD || mm->dying ||
+     mappages(p->pagetable, va, PGSIZE, (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    release(&mm->lock);
+    return -1;
+  }
+  mm->tfslots |= 1L << i;
+  mm->ref++;
+  // the usyscall page's pid is no longer every thread's.
+  ((struct usyscall*)walkaddr(p->pagetable, USYSCALL))->threaded = 1;
+  // set under the lock, for killthreads() to see.
+  np->mm = mm;
+  release(&mm->lock);
+
+  np->pagetable = p->pagetable;
+  np->trapva = va;
+  return 0;
+}
+
+// Take p's trapframe out of its address space, and free
+// the address space if no one else is using it.
+static void
+mmput(struct proc *p)
+{
+  struct mm *mm = p->mm;
+  int ref;
+
+  acquire(&mm->lock);
+  ref = --mm->ref;
+  if(ref > 0){
+    uvmunmap(p->pagetable, p->trapva, 1, 0);
+    mm->tfslots &= ~(1L << ((TRAPFRAME - p->trapva) / PGSIZE));
+  }
+  release(&mm->lock);
+  if(ref == 0){
+    proc_freepagetable(p->pagetable, mm->sz, p->trapva);
+    if(mm->ip){
+      begin_op();
+      iexecput(mm->ip);
+      end_op();
+    }
+    kmem_cache_free(&ptable.mmcache, mm);
+  }
+  p->mm = 0;
+  p->pagetable = 0;
+}
+
 // free a proc structure and the data hanging from it,
 // including user pages.
-// p->lock must be held.
+// p must be a zombie reaped by wait(), or never have run;
+// p->lock must not be held. once freepid() has run, lockpid()
+// can no longer find p, but a kill() or setaffinity() that
+// found it earlier may still hold p->lock; taking the lock
+// waits for it to finish with p.
 static void
 freeproc(struct proc *p)
 {
+  if(p->pid){
+    freepid(p);
+    acquire(&p->lock);
+    release(&p->lock);
+  }
+  if(p->mm)
+    mmput(p);
   if(p->trapframe)
     kfree((void*)p->trapframe);
-  p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
-  p->pid = 0;
-  p->parent = 0;
-  p->name[0] = 0;
-  p->chan = 0;
-  p->killed = 0;
-  p->xstate = 0;
+  if(p->kstack)
+    kstackfree(p->kstack);
+  if(p->fdt)
+    fdtput(p->fdt);
   p->state = UNUSED;
-  p->tracemask = 0; // do not forget this
+
+  acquire(&ptable.lock);
+  *p->allprev = p->allnext;
+  if(p->allnext)
+    p->allnext->allprev = p->allprev;
+  ptable.nproc--;
+  kinfo->nproc = ptable.nproc;
+  release(&ptable.lock);
+
+  kmem_cache_free(&ptable.cache, p);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -178,6 +557,7 @@ pagetable_t
 proc_pagetable(struct proc *p)
 {
   pagetable_t pagetable;
+  struct usyscall *u;
 
   // An empty page table.
   pagetable = uvmcreate();
@@ -203,16 +583,40 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map a page of facts about this process, and the page
+  // of kernel counters, for the user program to read.
+  if((u = kalloc()) == 0)
+    goto bad;
+  memset(u, 0, PGSIZE);
+  u->pid = p->pid;
+  if(mappages(pagetable, USYSCALL, PGSIZE, (uint64)u, PTE_R | PTE_U) < 0){
+    kfree(u);
+    goto bad;
+  }
+  if(mappages(pagetable, KINFO, PGSIZE, (uint64)kinfo, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, USYSCALL, 1, 1);
+    goto bad;
+  }
+
   return pagetable;
+
+ bad:
+  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+  uvmfree(pagetable, 0);
+  return 0;
 }
 
-// Free a process's page table, and free the
+// Free a process's page table, with the process's
+// trapframe mapped at trapva, and free the
 // physical memory it refers to.
 void
-proc_freepagetable(pagetable_t pagetable, uint64 sz)
+proc_freepagetable(pagetable_t pagetable, uint64 sz, uint64 trapva)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, trapva, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 1);
+  uvmunmap(pagetable, KINFO, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -236,12 +640,15 @@ userinit(void)
   struct proc *p;
 
   p = allocproc();
+  if(p == 0 || mmalloc(p) < 0 || (p->fdt = fdtalloc()) == 0)
+    panic("userinit");
   initproc = p;
   
   // allocate one user page and copy initcode's instructions
   // and data into it.
   uvmfirst(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->mm->sz = PGSIZE;
+  p->ru.npage = 1;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -250,29 +657,67 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
+// Return the old size on success, -1 on failure.
+// Memory shared with other threads cannot shrink, since
+// they may be using the pages on other harts.
+uint64
 growproc(int n)
 {
-  uint64 sz;
+  uint64 sz, oldsz;
   struct proc *p = myproc();
+  struct mm *mm = p->mm;
 
-  sz = p->sz;
+  acquire(&mm->lock);
+  oldsz = sz = mm->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > KINFO ||
+       (sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+      release(&mm->lock);
       return -1;
     }
   } else if(n < 0){
+    if(mm->ref > 1){
+      release(&mm->lock);
+      return -1;
+    }
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
-  return 0;
+  mm->sz = sz;
+  release(&mm->lock);
+  if(sz > oldsz)
+    p->ru.npage += (PGROUNDUP(sz) - PGROUNDUP(oldsz)) / PGSIZE;
+  return oldsz;
+}
+
+// Make np a child of p, and let it run, on p's CPUs.
+static void
+startchild(struct proc *p, struct proc *np)
+{
+  uint64 affinity;
+  int cpu;
+
+  acquire(&p->lock);
+  affinity = p->affinity;
+  cpu = p->cpu;
+  release(&p->lock);
+
+  acquire(&p->wait_lock);
+  np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
+  release(&p->wait_lock);
+
+  acquire(&np->lock);
+  np->affinity = affinity;
+  np->cpu = cpu;
+  setrunnable(np);
+  release(&np->lock);
 }
 
 // Create a new process, copying the parent.
@@ -280,7 +725,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *p = myproc();
 
@@ -290,12 +735,25 @@ fork(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if(mmalloc(np) < 0){
+    release(&np->lock);
     freeproc(np);
+    return -1;
+  }
+  acquire(&p->mm->lock);
+  if(uvmcopy(p->pagetable, np->pagetable, p->mm->sz) < 0){
+    release(&p->mm->lock);
     release(&np->lock);
+    freeproc(np);
     return -1;
   }
-  np->sz = p->sz;
+  np->mm->sz = p->mm->sz;
+  np->mm->nseg = p->mm->nseg;
+  memmove(np->mm->seg, p->mm->seg, sizeof(p->mm->seg));
+  if(p->mm->ip)
+    np->mm->ip = iexecdup(p->mm->ip);
+  np->ru.npage = PGROUNDUP(np->mm->sz) / PGSIZE;
+  release(&p->mm->lock);
 
   // copy trace mask
   np->tracemask = p->tracemask;
@@ -307,9 +765,11 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
+  if((np->fdt = fdtcopy(p->fdt)) == 0){
+    release(&np->lock);
+    freeproc(np);
+    return -1;
+  }
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
@@ -318,35 +778,166 @@ fork(void)
 
   release(&np->lock);
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  startchild(p, np);
 
-  acquire(&np->lock);
-  np->state = RUNNABLE;
+  return pid;
+}
+
+// Create a child running the program path with arguments argv,
+// without copying the caller's memory as fork() would only for
+// exec() to throw it away. The child's descriptor i is the
+// caller's descriptor fdmap[i], or closed if that is -1, for i
+// below nfd; with no fdmap, it inherits all of them.
+// Returns the child's pid, or -1.
+int
+spawn(char *path, char **argv, int *fdmap, int nfd)
+{
+  int pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  if(mmalloc(np) < 0){
+    release(&np->lock);
+    freeproc(np);
+    return -1;
+  }
+  np->fdt = fdmap ? fdtmap(p->fdt, fdmap, nfd) : fdtcopy(p->fdt);
+  if(np->fdt == 0){
+    release(&np->lock);
+    freeproc(np);
+    return -1;
+  }
+  np->tracemask = p->tracemask;
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+
+  // exec sleeps reading the program, so np->lock can't be
+  // held; np is not RUNNABLE yet, so nothing else uses it.
   release(&np->lock);
+  if((argc = execproc(np, path, argv)) < 0){
+    freeproc(np);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+  np->cwd = idup(p->cwd);
+
+  pid = np->pid;
+
+  startchild(p, np);
+
+  return pid;
+}
+
+// Create a thread: a new process that shares the caller's
+// memory and file descriptors, and starts in fn(arg) with
+// its stack pointer at stack.
+// Returns the new thread's pid, which join() takes.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if(stack % 16 != 0)
+    return -1;
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  if(mmshare(p, np) < 0){
+    release(&np->lock);
+    freeproc(np);
+    return -1;
+  }
+  np->thread = 1;
+
+  np->fdt = fdtshare(p->fdt);
+  np->cwd = idup(p->cwd);
+
+  np->tracemask = p->tracemask;
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->ra = 0;
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  startchild(p, np);
 
   return pid;
 }
 
 // Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Caller must hold p->wait_lock.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+  if(p->children == 0)
+    return;
+  acquire(&initproc->wait_lock);
+  while((pp = p->children) != 0){
+    p->children = pp->sibling;
+    pp->parent = initproc;
+    pp->sibling = initproc->children;
+    initproc->children = pp;
+  }
+  release(&initproc->wait_lock);
+  // some of them may already be zombies.
+  wakeup(initproc);
+}
+
+static int reap(int, int, uint64, int);
+
+// The main thread p is exiting: kill the other threads in
+// its address space, and reap those that are p's own as
+// they exit. Threads that they made go to init when their
+// parents exit, and init reaps them.
+static void
+killthreads(struct proc *p)
+{
+  struct mm *mm = p->mm;
+  struct proc *q;
+  int pid;
+
+  acquire(&mm->lock);
+  mm->dying = 1;
+  release(&mm->lock);
+
+  // kill() takes q->lock, which comes before ptable.lock,
+  // so find one victim at a time.
+  for(;;){
+    pid = 0;
+    acquire(&ptable.lock);
+    for(q = ptable.all; q; q = q->allnext){
+      if(q != p && q->mm == mm && q->pid != 0 && !q->killed){
+        pid = q->pid;
+        break;
+      }
     }
+    release(&ptable.lock);
+    if(pid == 0)
+      break;
+    kill(pid);
   }
+
+  while(reap(1, 0, 0, 0) > 0)
+    ;
 }
 
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
-// until its parent calls wait().
+// until its parent calls wait(). The main thread
+// takes the threads made by clone() with it.
 void
 exit(int status)
 {
@@ -355,89 +946,148 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
+  if(!p->thread && p->mm->ref > 1)
+    killthreads(p);
+
+  consolerelease(p->pid);
+
+  // Close all open files, unless other
+  // threads are still using them.
+  fdtput(p->fdt);
+  p->fdt = 0;
 
   begin_op();
   iput(p->cwd);
   end_op();
   p->cwd = 0;
 
-  acquire(&wait_lock);
-
   // Give any children to init.
+  acquire(&p->wait_lock);
   reparent(p);
+  release(&p->wait_lock);
+
+  // Lock the parent's child list, which our parent pointer
+  // is stable under. The parent may be exiting and handing
+  // us to init as we look, so check we locked the right one;
+  // pid_lock keeps it from being freed meanwhile.
+  struct proc *pp;
+  for(;;){
+    acquire(&pid_lock);
+    pp = p->parent;
+    acquire(&pp->wait_lock);
+    release(&pid_lock);
+    if(p->parent == pp)
+      break;
+    release(&pp->wait_lock);
+  }
 
   // Parent might be sleeping in wait().
-  wakeup(p->parent);
+  wakeup(pp);
   
   acquire(&p->lock);
 
   p->xstate = status;
   p->state = ZOMBIE;
 
-  release(&wait_lock);
+  release(&pp->wait_lock);
 
   // Jump into the scheduler, never to return.
   sched();
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int
-wait(uint64 addr)
+// add b's usage to a.
+static void
+ruadd(struct rusage *a, struct rusage *b)
 {
-  struct proc *pp;
-  int havekids, pid;
+  a->utime += b->utime;
+  a->stime += b->stime;
+  a->nvcsw += b->nvcsw;
+  a->nivcsw += b->nivcsw;
+  a->nsyscall += b->nsyscall;
+  a->npage += b->npage;
+  a->nfault += b->nfault;
+}
+
+// Wait for a child to exit and return its pid: a child
+// thread, with the given pid unless that is 0, if thread is
+// set, or else any child process. init also reaps threads
+// orphaned by their parents.
+// Return -1 if this process has no such children, or if
+// intr is set and this process has been killed.
+static int
+reap(int thread, int tid, uint64 addr, int intr)
+{
+  struct proc *pp, **link;
+  int pid, havekids;
   struct proc *p = myproc();
 
-  acquire(&wait_lock);
+  // the copyout() below is done holding locks.
+  if(addr != 0)
+    execprefault(addr, sizeof(pp->xstate), PTE_W);
+
+  acquire(&p->wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
+    for(link = &p->children; (pp = *link) != 0; link = &pp->sibling){
+      if(pp->thread != thread && p != initproc)
+        continue;
+      if(tid != 0 && pp->pid != tid)
+        continue;
+      havekids = 1;
+
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      if(pp->state == ZOMBIE){
+        // Found one.
+        pid = pp->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                sizeof(pp->xstate)) < 0) {
           release(&pp->lock);
-          release(&wait_lock);
-          return pid;
+          release(&p->wait_lock);
+          return -1;
         }
+        *link = pp->sibling;
+        ruadd(&p->cru, &pp->ru);
+        ruadd(&p->cru, &pp->cru);
         release(&pp->lock);
+        release(&p->wait_lock);
+        freeproc(pp);
+        return pid;
       }
+      release(&pp->lock);
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || killed(p)){
-      release(&wait_lock);
+    if(!havekids || (intr && killed(p))){
+      release(&p->wait_lock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->wait_lock);  //DOC: wait-sleep
   }
 }
 
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(uint64 addr)
+{
+  return reap(0, 0, addr, 1);
+}
+
+// Wait for child thread tid, or for any child thread
+// if tid is 0, to exit, and return its pid.
+int
+join(int tid, uint64 addr)
+{
+  return reap(1, tid, addr, 1);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -450,25 +1100,52 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 now;
   
   c->proc = 0;
+  c->stamp = r_time();
+  __sync_fetch_and_or(&cpuonline, 1UL << id);
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
+    if((p = runq_take(id)) == 0) {
+      // nothing to run; wait for an interrupt. with interrupts
+      // off, a kick() that arrives after the second look at
+      // the run queues stays pending, and wfi returns at once.
+      intr_off();
+      __sync_fetch_and_or(&idlecpus, 1UL << id);
+      if((p = runq_take(id)) == 0)
+        asm volatile("wfi");
+      __sync_fetch_and_and(&idlecpus, ~(1UL << id));
+    }
+
+    if(p != 0) {
       acquire(&p->lock);
       if(p->state == RUNNABLE) {
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
         p->state = RUNNING;
+        p->cpu = id;
         c->proc = p;
+        c->nswtch++;
+        now = r_time();
+        c->idle += now - c->stamp;
+        c->stamp = now;
+        p->stamp = now;
+        clockslice();
+        kstackfence();
         swtch(&c->context, &p->context);
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
+        now = r_time();
+        c->busy += now - c->stamp;
+        c->stamp = now;
+        p->ru.stime += now - p->stamp;
       }
       release(&p->lock);
     }
@@ -497,18 +1174,35 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  notestack();
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
 
+// Note how much of the current process's kernel stack is in
+// use, for p->maxstack. Called where the stack is likely to
+// be deep: when a process sleeps, and at kernel traps.
+void
+notestack(void)
+{
+  struct proc *p = myproc();
+  uint64 sp = r_sp();
+
+  if(p == 0 || sp < p->kstack || sp > p->kstack + PGSIZE)
+    return;   // on a CPU's boot stack
+  if(p->kstack + PGSIZE - sp > p->maxstack)
+    p->maxstack = p->kstack + PGSIZE - sp;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  p->ru.nivcsw++;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -534,53 +1228,174 @@ forkret(void)
   usertrapret();
 }
 
+// Remove p from the sleep queue q.
+// Caller must hold q->lock.
+static void
+dequeue(struct sleepq *q, struct proc *p)
+{
+  if(p->qprev == 0)
+    return;
+  *p->qprev = p->qnext;
+  if(p->qnext)
+    p->qnext->qprev = p->qprev;
+  else
+    q->tail = p->qprev;
+  p->qnext = 0;
+  p->qprev = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = chanq(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we hold q->lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks q->lock, then p->lock),
   // so it's okay to release lk.
 
+  acquire(&q->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
-  // Go to sleep.
+  // Go to sleep, at the end of the queue.
   p->chan = chan;
+  p->qnext = 0;
+  p->qprev = q->tail;
+  *q->tail = p;
+  q->tail = &p->qnext;
   p->state = SLEEPING;
+  p->ru.nvcsw++;
+  release(&q->lock);
 
   sched();
 
-  // Tidy up.
+  // Tidy up. wakeup() has taken us off the queue,
+  // unless something else (e.g. kill()) woke us.
+  release(&p->lock);
+  acquire(&q->lock);
+  dequeue(q, p);
   p->chan = 0;
+  release(&q->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
+// Wake up at most n processes sleeping on chan,
+// or all of them if n is negative.
+// Returns the number woken.
+// Must be called without any p->lock.
+int
+wakeupn(void *chan, int n)
+{
+  struct sleepq *q = chanq(chan);
+  struct proc *p, *next;
+  int woken = 0;
+
+  acquire(&q->lock);
+  for(p = q->head; p && woken != n; p = next){
+    next = p->qnext;
+    if(p->chan != chan || p == myproc())
+      continue;
+    dequeue(q, p);
+    acquire(&p->lock);
+    if(p->state == SLEEPING) {
+      setrunnable(p);
+      woken++;
+    }
+    release(&p->lock);
+  }
+  release(&q->lock);
+  return woken;
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wakeupn(chan, -1);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+// Wake up one process sleeping on chan, for when
+// only one of them could make progress anyway.
+// Must be called without any p->lock.
+void
+wakeup1(void *chan)
+{
+  wakeupn(chan, 1);
+}
+
+// Wait on, or wake processes waiting on, the int at user
+// address uaddr. Waiters sleep on the word's physical
+// address, so threads sharing memory find each other.
+// FUTEX_WAIT sleeps if the word still holds val, and returns
+// 0 when woken, or -1 if it did not sleep or was killed.
+// FUTEX_WAKE wakes at most val waiters, and returns how many.
+int
+futex(uint64 uaddr, int op, int val)
+{
+  struct proc *p = myproc();
+  struct spinlock *lk;
+  uint64 pa;
+  int *w, n;
+
+  if(uaddr % sizeof(int) != 0)
+    return -1;
+  if((pa = walkaddr(p->pagetable, PGROUNDDOWN(uaddr))) == 0){
+    // perhaps a program page exec() has not loaded yet.
+    if(execfault(p->pagetable, uaddr, PTE_R) != 0 ||
+       (pa = walkaddr(p->pagetable, PGROUNDDOWN(uaddr))) == 0)
+      return -1;
+  }
+  w = (int*)(pa + uaddr % PGSIZE);
+
+  // holding lk from checking the word until asleep
+  // keeps a FUTEX_WAKE from slipping in between.
+  lk = &futexlock[chanq(w) - sleepq];
+  acquire(lk);
+  switch(op){
+  case FUTEX_WAIT:
+    if(*(volatile int*)w != val || killed(p)){
+      n = -1;
+      break;
     }
+    sleep(w, lk);
+    n = killed(p) ? -1 : 0;
+    break;
+  case FUTEX_WAKE:
+    n = wakeupn(w, val);
+    break;
+  default:
+    n = -1;
   }
+  release(lk);
+  return n;
+}
+
+// Find the process with the given pid, and return it
+// with its lock held, or return 0.
+static struct proc*
+lockpid(int pid)
+{
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  if(p)
+    acquire(&p->lock);
+  release(&pid_lock);
+  return p;
 }
 
 // Kill the process with the given pid.
@@ -591,20 +1406,90 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
+  if((p = lockpid(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Restrict the process with the given pid, or the caller
+// if pid is 0, to the CPUs in mask. A process waiting in
+// a run queue is requeued for an allowed CPU, and one
+// running elsewhere moves at the end of its time slice;
+// the caller moves at once.
+// Returns 0, or -1 if there is no such process or mask
+// has no running CPUs.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+  int self;
+
+  if((mask & cpuonline) == 0)
+    return -1;
+  self = (pid == 0 || pid == myproc()->pid);
+  if(self){
+    p = myproc();
     acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  } else if((p = lockpid(pid)) == 0){
+    return -1;
   }
-  return -1;
+  p->affinity = mask;
+  // the CPU whose queue p is on may no longer take it,
+  // and the ones that may could be idle in wfi.
+  if(p->state == RUNNABLE && runq_remove(p))
+    setrunnable(p);
+  release(&p->lock);
+
+  if(self && (mask & (1UL << cpuid())) == 0)
+    yield();
+  return 0;
+}
+
+// Copy the caller's resource usage, or its reaped
+// children's, to the user struct rusage at addr.
+int
+getrusage(int who, uint64 addr)
+{
+  struct proc *p = myproc();
+  struct rusage ru;
+
+  if(who == RUSAGE_SELF){
+    ru = p->ru;
+    ru.stime += r_time() - p->stamp;   // this system call so far
+  } else if(who == RUSAGE_CHILDREN){
+    ru = p->cru;
+  } else {
+    return -1;
+  }
+  return copyout(p->pagetable, addr, (char*)&ru, sizeof(ru));
+}
+
+// Copy load statistics for up to n CPUs to the user
+// array addr. Returns the number of CPUs, NCPU.
+int
+cpustat(uint64 addr, int n)
+{
+  struct cpustat cs;
+  struct cpu *c;
+  int i;
+
+  for(i = 0; i < n && i < NCPU; i++){
+    c = &cpus[i];
+    memset(&cs, 0, sizeof(cs));
+    cs.online = (cpuonline >> i) & 1;
+    cs.busy = c->busy;
+    cs.idle = c->idle;
+    cs.nswtch = c->nswtch;
+    if(copyout(myproc()->pagetable, addr + i*sizeof(cs), (char*)&cs, sizeof(cs)) < 0)
+      return -1;
+  }
+  return NCPU;
 }
 
 void
@@ -656,11 +1541,8 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
-// Print a process listing to console.  For debugging.
-// Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
-void
-procdump(void)
+static char*
+statename(struct proc *p)
 {
   static char *states[] = {
   [UNUSED]    "unused",
@@ -670,20 +1552,96 @@ procdump(void)
   [RUNNING]   "run   ",
   [ZOMBIE]    "zombie"
   };
+
+  if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
+    return states[p->state];
+  return "???";
+}
+
+// Print a process listing to console.  For debugging.
+// Runs when user types ^P on console.
+// Takes only ptable.lock, which keeps procs from being
+// freed, to avoid wedging a stuck machine further.
+// For a sleeping process, also prints where in the
+// kernel it sleeps, from the frames on its stack.
+void
+procdump(void)
+{
   struct proc *p;
-  char *state;
+  uint64 pcs[10];
+  int i, n;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  acquire(&ptable.lock);
+  kstackfence();   // for getcallerpcs() on other stacks
+  for(p = ptable.all; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
+    printf("%d %s %s", p->pid, statename(p), p->name);
+    printf(" cpu %d user %dms sys %dms syscalls %d",
+           p->cpu, (int)(p->ru.utime / (TIMEBASE / 1000)),
+           (int)(p->ru.stime / (TIMEBASE / 1000)), (int)p->ru.nsyscall);
+    printf(" kstack %d", (int)p->maxstack);
+    if(p->state == SLEEPING){
+      n = getcallerpcs(p->context.s0, pcs, NELEM(pcs));
+      for(i = 0; i < n; i++)
+        printf(" %p", pcs[i]);
+    }
     printf("\n");
   }
+  release(&ptable.lock);
+}
+
+// Copy a struct procstat for each of up to n processes
+// to the user array addr. Returns the number copied.
+// Collects a page of them at a time, so a process that
+// comes or goes meanwhile may be missed or listed twice.
+int
+procstat(uint64 addr, int n)
+{
+  struct procstat *buf, *ps;
+  struct proc *p;
+  int i, k, skip, cap;
+
+  if((buf = (struct procstat*)kalloc()) == 0)
+    return -1;
+  cap = PGSIZE / sizeof(*buf);
+  for(i = 0; i < n; i += k){
+    k = 0;
+    skip = i;
+    // pid_lock keeps a proc with a pid, its mm, and its
+    // parent from being freed.
+    acquire(&pid_lock);
+    acquire(&ptable.lock);
+    for(p = ptable.all; p && k < cap && i + k < n; p = p->allnext){
+      if(p->pid == 0)
+        continue;
+      if(skip > 0){
+        skip--;
+        continue;
+      }
+      ps = &buf[k++];
+      memset(ps, 0, sizeof(*ps));
+      ps->pid = p->pid;
+      ps->ppid = p->parent ? p->parent->pid : 0;
+      ps->cpu = p->cpu;
+      safestrcpy(ps->state, statename(p), sizeof(ps->state));
+      safestrcpy(ps->name, p->name, sizeof(ps->name));
+      ps->sz = p->mm ? p->mm->sz : 0;
+      ps->maxstack = p->maxstack;
+      ps->ru = p->ru;
+    }
+    release(&ptable.lock);
+    release(&pid_lock);
+    if(k == 0)
+      break;
+    if(copyout(myproc()->pagetable, addr + i*sizeof(*buf), (char*)buf, k*sizeof(*buf)) < 0){
+      kfree(buf);
+      return -1;
+    }
+  }
+  kfree(buf);
+  return i;
 }
 
 
@@ -692,14 +1650,9 @@ procdump(void)
 int
 acquire_nproc()
 {
-  int n = 0;
-  struct proc *p;
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
-    acquire(&p->lock);
-    if (p->state != UNUSED)
-      n++;
-    release(&p->lock);
-  }
+  int n;
+  acquire(&ptable.lock);
+  n = ptable.nproc;
+  release(&ptable.lock);
   return n;
 }
\ No newline at end of file
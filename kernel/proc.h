@@ -24,6 +24,15 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 timecmp;             // When this hart's timer fires; see timer.c.
+  uint64 sliceend;            // When the running process's time slice ends.
+
+  // load accounting, in time CSR units; see scheduler().
+  uint64 busy;                // Time spent running processes.
+  uint64 idle;                // Time spent looking for one.
+  uint64 stamp;               // When busy or idle was last updated.
+  uint64 nswtch;              // Processes run.
+  int kstackseen;             // Kernel stacks mapped at last TLB flush.
 };
 
 extern struct cpu cpus[NCPU];
@@ -81,29 +90,93 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A segment of the program that exec() left for
+// execfault() to load a page at a time.
+struct seg {
+  uint64 va;                   // start, page-aligned
+  uint64 end;                  // va + size in memory
+  uint64 fileend;              // va + size in the file
+  uint off;                    // file offset of va
+  int perm;                    // PTE_X and PTE_W
+};
+
+// A user address space. threads made by clone() share one,
+// each with its own trapframe mapped in one of the
+// MAXTHREAD slots below TRAMPOLINE.
+struct mm {
+  struct spinlock lock;        // protects everything below,
+                               // and changes to the page table
+  int ref;                     // processes using this address space
+  int dying;                   // main thread exiting; no new threads
+  uint64 sz;                   // Size of process memory (bytes)
+  uint64 tfslots;              // bitmap of trapframe slots in use
+  struct inode *ip;            // program file, or 0
+  int nseg;                    // segments loaded from ip on demand
+  struct seg seg[MAXSEG];
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
-  void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // CPU it last ran on, or -1
+  uint64 affinity;             // Bitmask of CPUs it may run on
+
+  // the lock of chan's sleep queue must be held when using these:
+  void *chan;                  // If non-zero, sleeping on chan
+  struct proc *qnext;          // Next in sleep queue
+  struct proc **qprev;         // Link pointing at us, or 0 if not queued
+
+  // timerq.lock must be held when using these:
+  uint64 wakeat;               // If non-zero, in timerq until this time
+  struct proc *tnext;          // Next in timerq
 
-  // wait_lock must be held when using this:
+  // protects children, and each child's parent and sibling.
+  // lock order: p->wait_lock, then initproc->wait_lock,
+  // then any p->lock.
+  struct spinlock wait_lock;
+  struct proc *children;       // Child processes, through sibling
+
+  // the parent's wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *sibling;        // Next child of parent
+
+  // pid_lock must be held when using this:
+  struct proc *pidnext;        // Next in pid hash chain
+
+  // ptable.lock must be held when using these:
+  struct proc *allnext;        // Next in ptable.all
+  struct proc **allprev;       // Link pointing at us
+
+  // the lock of its CPU's run queue must be held when using this:
+  struct proc *rnext;          // Next in run queue, if RUNNABLE
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  uint64 maxstack;             // Most of kstack seen in use, in bytes
+  int nsleeplock;              // Sleep locks held; see execfault()
+  struct mm *mm;               // Address space, maybe shared
+  pagetable_t pagetable;       // User page table, mm's
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 trapva;               // where trapframe is mapped
+  int thread;                  // made by clone(); reaped by join()
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct fdtable *fdt;         // Open files, maybe shared
+  struct file *fdref;          // held until syscall returns; see fdget()
   struct inode *cwd;           // Current directory
 
+  // resource usage. updated by the process itself, and by the
+  // scheduler while it is not running; others read it without
+  // locking, and may see slightly stale values.
+  uint64 stamp;                // When utime or stime was last charged
+  struct rusage ru;            // This process's own usage
+  struct rusage cru;           // Reaped children's, and theirs
+
   char name[16];               // Process name (debugging)
   int tracemask;               // mask for trace
 };
@@ -0,0 +1,169 @@
+// Sampling profiler.
+//
+// While it is on, a hart that is running a process asks for
+// a timer interrupt every proftick time units as well as at
+// the end of the time slice (see timer.c). devintr() calls
+// profsample() at each timer interrupt to record where the
+// hart was, and which process was running, in the hart's
+// own buffer. prof() starts and stops sampling and drains
+// the buffers to user space.
+//
+// A sample is only taken where interrupts are enabled, so
+// time spent holding a spinlock is charged to the code that
+// releases it. A kernel sample also records who called the
+// interrupted function, found by walking the frame pointers
+// back through kernelvec.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+#define NPROFBUF 1024       // samples per CPU
+
+struct profbuf {
+  struct spinlock lock;
+  int n;                    // samples in buf
+  uint64 dropped;           // samples lost to a full buf
+  struct profsample buf[NPROFBUF];
+} profbufs[NCPU];
+
+uint64 proftick;            // sampling interval, or 0 if off
+
+extern char kernelvecret[]; // kernelvec.S
+
+void
+profinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&profbufs[i].lock, "prof");
+}
+
+// the sampling interval in time CSR units, or 0 if off.
+uint64
+profinterval(void)
+{
+  return proftick;
+}
+
+// the return address of the kernel function that a trap
+// interrupted: the one after kerneltrap()'s, which returns
+// to kernelvec. or 0 if it can't be found.
+static uint64
+trapcaller(void)
+{
+  uint64 pcs[8];
+  int i, n;
+
+  n = getcallerpcs(r_fp(), pcs, NELEM(pcs));
+  for(i = 0; i + 1 < n; i++)
+    if(pcs[i] == (uint64)kernelvecret)
+      return pcs[i+1];
+  return 0;
+}
+
+// record that this hart was at pc. interrupts must be off.
+void
+profsample(uint64 pc, int user)
+{
+  struct profbuf *b = &profbufs[cpuid()];
+  struct proc *p = myproc();
+  struct profsample *s;
+  uint64 caller = user ? 0 : trapcaller();
+
+  acquire(&b->lock);
+  if(b->n < NPROFBUF){
+    s = &b->buf[b->n++];
+    s->pc = pc;
+    s->caller = caller;
+    s->pid = p ? p->pid : 0;
+    s->cpu = cpuid();
+    s->user = user;
+  } else {
+    b->dropped++;
+  }
+  release(&b->lock);
+}
+
+// copy up to n samples from the end of b to the user
+// array addr. returns the number copied, or -1.
+static int
+drain(struct profbuf *b, uint64 addr, int n)
+{
+  struct profsample tmp[16];
+  int k, total;
+
+  for(total = 0; total < n; total += k){
+    acquire(&b->lock);
+    k = b->n;
+    if(k > NELEM(tmp))
+      k = NELEM(tmp);
+    if(k > n - total)
+      k = n - total;
+    b->n -= k;
+    memmove(tmp, &b->buf[b->n], k * sizeof(tmp[0]));
+    release(&b->lock);
+    if(k == 0)
+      break;
+    // copy with the lock released, so that copyout()
+    // may fault in the user's pages.
+    if(copyout(myproc()->pagetable, addr + total*sizeof(tmp[0]),
+               (char*)tmp, k * sizeof(tmp[0])) < 0)
+      return -1;
+  }
+  return total;
+}
+
+// Control the profiler; see prof.h. For PROF_START, arg
+// is the sampling interval in time CSR units, or 0 for
+// PROFTICK; for PROF_READ, the user address to copy to.
+int
+prof(int cmd, uint64 arg, int n)
+{
+  struct profbuf *b;
+  uint64 dropped;
+  int k, total;
+
+  switch(cmd){
+  case PROF_START:
+    for(b = profbufs; b < &profbufs[NCPU]; b++){
+      acquire(&b->lock);
+      b->n = 0;
+      b->dropped = 0;
+      release(&b->lock);
+    }
+    if(arg == 0)
+      arg = PROFTICK;
+    if(arg < PROFTICK/10)
+      arg = PROFTICK/10;   // don't drown the harts in interrupts
+    proftick = arg;
+    return 0;
+
+  case PROF_STOP:
+    proftick = 0;
+    dropped = 0;
+    for(b = profbufs; b < &profbufs[NCPU]; b++){
+      acquire(&b->lock);
+      dropped += b->dropped;
+      release(&b->lock);
+    }
+    return dropped;
+
+  case PROF_READ:
+    total = 0;
+    for(b = profbufs; b < &profbufs[NCPU] && total < n; b++){
+      if((k = drain(b, arg + total*sizeof(struct profsample), n - total)) < 0)
+        return -1;
+      total += k;
+    }
+    return total;
+  }
+  return -1;
+}
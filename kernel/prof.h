@@ -0,0 +1,13 @@
+// sampling profiler requests, for prof().
+#define PROF_START 1    // clear the buffers and start sampling
+#define PROF_STOP  2    // stop; returns the samples dropped
+#define PROF_READ  3    // drain up to n samples to addr
+
+// one sample, taken at a timer interrupt.
+struct profsample {
+  uint64 pc;        // where the hart was interrupted
+  uint64 caller;    // in the kernel, the return address there, or 0
+  int pid;          // process running there, or 0 if none
+  short cpu;
+  short user;       // 1 if pc is a user address
+};
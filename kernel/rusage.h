@@ -0,0 +1,27 @@
+// resource usage, as returned by getrusage() and procstat().
+// times are in units of the time CSR, TIMEBASE per second.
+
+#define RUSAGE_SELF      0
+#define RUSAGE_CHILDREN  (-1)   // reaped children, and theirs
+
+struct rusage {
+  uint64 utime;     // time in user mode
+  uint64 stime;     // time in the kernel
+  uint64 nvcsw;     // voluntary context switches
+  uint64 nivcsw;    // involuntary context switches
+  uint64 nsyscall;  // system calls made
+  uint64 npage;     // user memory pages allocated
+  uint64 nfault;    // program pages loaded on first touch
+};
+
+// one process, as listed by procstat().
+struct procstat {
+  int pid;
+  int ppid;
+  int cpu;          // CPU it last ran on, or -1
+  char state[8];
+  char name[16];
+  uint64 sz;        // size of user memory (bytes)
+  uint64 maxstack;  // most of its kernel stack seen in use (bytes)
+  struct rusage ru; // its own usage, without its children's
+};
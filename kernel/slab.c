@@ -0,0 +1,285 @@
+// Slab allocator for small fixed-size kernel objects,
+// built on top of kalloc()'s 4096-byte pages.
+//
+// Each cache carves whole pages ("slabs") into equal-sized
+// objects. A slab page starts with a struct slab header,
+// so the slab owning an object is PGROUNDDOWN(object).
+//
+// To keep the common case off the cache lock, each CPU has
+// a small magazine of recently freed objects. Allocation pops
+// from the local magazine; free pushes onto it, and when it
+// fills up, half of it goes back to the slabs.
+//
+// Interface:
+// * kmem_cache_init() once per cache, at boot.
+// * kmem_cache_alloc() returns an uninitialized object, or 0.
+// * kmem_cache_free() gives an object back to its cache.
+// * kmem_cache_reap() returns cached memory to kalloc();
+//   kalloc() calls it when it runs out of pages.
+//
+// Lock order: magazine lock, then cache lock, then kmem.lock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct run {
+  struct run *next;
+};
+
+// header at the start of every slab page.
+struct slab {
+  struct slab *next;
+  struct slab *prev;
+  struct kmem_cache *cache;
+  struct run *freelist;   // free objects in this slab
+  uint inuse;             // allocated objects in this slab
+};
+
+#define SLAB_HDRSIZE ((sizeof(struct slab) + 7) & ~7)
+
+extern char end[]; // first address after kernel; see kernel.ld.
+
+// all caches, for kmem_cache_reap().
+// only modified during boot, by kmem_cache_init().
+static struct kmem_cache *caches;
+
+static void
+slab_push(struct slab **head, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *head;
+  if(*head)
+    (*head)->prev = s;
+  *head = s;
+}
+
+static void
+slab_remove(struct slab **head, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *head = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+// Initialize cache c for objects of the given size.
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  int i;
+
+  size = (size + 7) & ~7;
+  if(size < sizeof(struct run) || size > PGSIZE - SLAB_HDRSIZE)
+    panic("kmem_cache_init: size");
+
+  initlock(&c->lock, "kmem_cache");
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLAB_HDRSIZE) / size;
+
+  // a magazine should not pin more than about half a slab
+  // per CPU, or caches of big objects hoard whole pages.
+  c->magsize = c->perslab / 2;
+  if(c->magsize < 1)
+    c->magsize = 1;
+  if(c->magsize > SLAB_MAGSIZE)
+    c->magsize = SLAB_MAGSIZE;
+
+  c->partial = c->full = c->empty = 0;
+  c->nslab = 0;
+  for(i = 0; i < NCPU; i++){
+    initlock(&c->cpu[i].lock, "kmem_cpu");
+    c->cpu[i].rounds = 0;
+  }
+
+  c->next = caches;
+  caches = c;
+}
+
+// Take one object from c's slabs.
+// Caller must hold c->lock.
+static void*
+slab_take(struct kmem_cache *c)
+{
+  struct slab *s;
+  struct run *r;
+
+  if((s = c->partial) == 0){
+    if((s = c->empty) == 0)
+      return 0;
+    c->empty = 0;
+    slab_push(&c->partial, s);
+  }
+
+  r = s->freelist;
+  s->freelist = r->next;
+  s->inuse++;
+  if(s->freelist == 0){
+    slab_remove(&c->partial, s);
+    slab_push(&c->full, s);
+  }
+  return (void*)r;
+}
+
+// Return one object to its slab, and give the slab's
+// page back to kalloc() if it is now unused and the
+// cache already has a spare.
+// Caller must hold c->lock.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+  struct run *r = (struct run*)obj;
+
+  if(s->cache != c || s->inuse == 0)
+    panic("slab_put");
+
+  if(s->freelist == 0){
+    slab_remove(&c->full, s);
+    slab_push(&c->partial, s);
+  }
+  r->next = s->freelist;
+  s->freelist = r;
+  s->inuse--;
+
+  if(s->inuse == 0){
+    slab_remove(&c->partial, s);
+    if(c->empty == 0){
+      c->empty = s;
+    } else {
+      c->nslab--;
+      kfree((void*)s);
+    }
+  }
+}
+
+// Carve a fresh page into a slab for c.
+static struct slab*
+slab_new(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->next = s->prev = 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->freelist = 0;
+  obj = (char*)s + SLAB_HDRSIZE;
+  for(i = 0; i < c->perslab; i++, obj += c->size){
+    ((struct run*)obj)->next = s->freelist;
+    s->freelist = (struct run*)obj;
+  }
+  return s;
+}
+
+// Allocate one object from cache c.
+// Returns 0 if no memory is available.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct kmem_cpu *m;
+  struct slab *s;
+  void *obj;
+
+  // fast path: this CPU's magazine.
+  push_off();
+  m = &c->cpu[cpuid()];
+  acquire(&m->lock);
+  pop_off();
+  if(m->rounds > 0){
+    obj = m->objs[--m->rounds];
+    release(&m->lock);
+    return obj;
+  }
+  release(&m->lock);
+
+  acquire(&c->lock);
+  obj = slab_take(c);
+  release(&c->lock);
+  if(obj)
+    return obj;
+
+  // no free objects anywhere; grow the cache.
+  // kalloc() may reap caches, so call it without
+  // holding any cache locks.
+  if((s = slab_new(c)) == 0)
+    return 0;
+  acquire(&c->lock);
+  c->nslab++;
+  slab_push(&c->partial, s);
+  obj = slab_take(c);
+  release(&c->lock);
+  return obj;
+}
+
+// Free an object previously returned by
+// kmem_cache_alloc(c).
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct kmem_cpu *m;
+
+  if(((uint64)obj % 8) != 0 || (char*)obj < end || (uint64)obj >= PHYSTOP)
+    panic("kmem_cache_free");
+
+  push_off();
+  m = &c->cpu[cpuid()];
+  acquire(&m->lock);
+  pop_off();
+  if(m->rounds < c->magsize){
+    m->objs[m->rounds++] = obj;
+    release(&m->lock);
+    return;
+  }
+
+  // magazine is full; move half of it, and obj,
+  // back to the slabs in one cache lock acquisition.
+  acquire(&c->lock);
+  while(m->rounds > c->magsize / 2)
+    slab_put(c, m->objs[--m->rounds]);
+  slab_put(c, obj);
+  release(&c->lock);
+  release(&m->lock);
+}
+
+// Flush every magazine and free every unused slab,
+// returning the pages to kalloc().
+// Must not be called with any cache lock held.
+void
+kmem_cache_reap(void)
+{
+  struct kmem_cache *c;
+  struct kmem_cpu *m;
+  struct slab *s;
+
+  for(c = caches; c; c = c->next){
+    for(m = c->cpu; m < &c->cpu[NCPU]; m++){
+      acquire(&m->lock);
+      acquire(&c->lock);
+      while(m->rounds > 0)
+        slab_put(c, m->objs[--m->rounds]);
+      release(&c->lock);
+      release(&m->lock);
+    }
+
+    acquire(&c->lock);
+    s = c->empty;
+    c->empty = 0;
+    if(s)
+      c->nslab--;
+    release(&c->lock);
+    if(s)
+      kfree((void*)s);
+  }
+}
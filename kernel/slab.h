@@ -0,0 +1,26 @@
+// Object caches for small fixed-size kernel structures.
+// See slab.c.
+
+#define SLAB_MAGSIZE 16   // max objects in a per-CPU magazine
+
+// Per-CPU magazine: a small stack of free objects that
+// the owning CPU can hand out without touching the slabs.
+struct kmem_cpu {
+  struct spinlock lock;   // almost never contended
+  int rounds;             // number of objects in objs[]
+  void *objs[SLAB_MAGSIZE];
+};
+
+struct kmem_cache {
+  struct spinlock lock;   // protects the slab lists below
+  char *name;             // for debugging
+  uint size;              // object size, rounded up to 8 bytes
+  uint perslab;           // objects that fit in one slab page
+  uint magsize;           // magazine capacity, <= SLAB_MAGSIZE
+  struct slab *partial;   // slabs with at least one free object
+  struct slab *full;      // slabs with no free objects
+  struct slab *empty;     // at most one completely free slab, kept warm
+  uint nslab;             // pages currently owned by this cache
+  struct kmem_cache *next; // list of all caches, for kmem_reap()
+  struct kmem_cpu cpu[NCPU];
+};
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
@@ -12,7 +13,7 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+  if(addr >= p->mm->sz || addr+sizeof(uint64) > p->mm->sz) // both tests needed, in case of overflow
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -105,6 +106,18 @@ extern uint64 sys_close(void);
 
 extern uint64 sys_trace(void);
 extern uint64 sys_sysinfo(void);
+extern uint64 sys_ioctl(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_cpustat(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_procstat(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_prof(void);
+extern uint64 sys_backtrace(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -134,6 +147,18 @@ static uint64 (*syscalls[])(void) = {
 
 [SYS_trace]   sys_trace,
 [SYS_sysinfo] sys_sysinfo,
+[SYS_ioctl]   sys_ioctl,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_cpustat] sys_cpustat,
+[SYS_getrusage] sys_getrusage,
+[SYS_procstat] sys_procstat,
+[SYS_spawn]   sys_spawn,
+[SYS_prof]    sys_prof,
+[SYS_backtrace] sys_backtrace,
 };
 
 static char *syscall_name[] = {
@@ -160,6 +185,18 @@ static char *syscall_name[] = {
 [SYS_close]   "sys_close",
 [SYS_trace]   "sys_trace",
 [SYS_sysinfo] "sys_sysinfo",
+[SYS_ioctl]   "sys_ioctl",
+[SYS_nanosleep] "sys_nanosleep",
+[SYS_clone]   "sys_clone",
+[SYS_join]    "sys_join",
+[SYS_futex]   "sys_futex",
+[SYS_setaffinity] "sys_setaffinity",
+[SYS_cpustat] "sys_cpustat",
+[SYS_getrusage] "sys_getrusage",
+[SYS_procstat] "sys_procstat",
+[SYS_spawn]   "sys_spawn",
+[SYS_prof]    "sys_prof",
+[SYS_backtrace] "sys_backtrace",
 };
 
 
@@ -170,13 +207,15 @@ syscall(void)
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
+  p->ru.nsyscall++;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
     p->trapframe->a0 = syscalls[num]();
+    fdput(p);
 
-    // trace 
-    if(p->tracemask & (1 << num))
+    // trace; the mask only has room for the first 32 calls.
+    if(num < 32 && ((p->tracemask >> num) & 1))
       printf("%d: %s -> %d\n", sys_getpid(), syscall_name[num], p->trapframe->a0);
     
     // myself version
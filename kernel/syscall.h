@@ -22,4 +22,16 @@
 #define SYS_close  21
 
 #define SYS_trace  22
-#define SYS_sysinfo 23
\ No newline at end of file
+#define SYS_sysinfo 23
+#define SYS_ioctl  24
+#define SYS_nanosleep 25
+#define SYS_clone  26
+#define SYS_join   27
+#define SYS_futex  28
+#define SYS_setaffinity 29
+#define SYS_cpustat 30
+#define SYS_getrusage 31
+#define SYS_procstat 32
+#define SYS_spawn  33
+#define SYS_prof   34
+#define SYS_backtrace 35
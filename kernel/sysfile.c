@@ -10,6 +10,7 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
@@ -17,7 +18,8 @@
 #include "fcntl.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// which stays open until the system call returns; see fdget().
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -25,7 +27,7 @@ argfd(int n, int *pfd, struct file **pf)
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(myproc(), fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -34,23 +36,6 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
-static int
-fdalloc(struct file *f)
-{
-  int fd;
-  struct proc *p = myproc();
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
-}
-
 uint64
 sys_dup(void)
 {
@@ -59,9 +44,11 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
-    return -1;
   filedup(f);
+  if((fd=fdalloc(myproc(), f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -76,6 +63,8 @@ sys_read(void)
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
+  if(n > 0)
+    execprefault(p, n, PTE_W);
   return fileread(f, p, n);
 }
 
@@ -90,19 +79,36 @@ sys_write(void)
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
+  if(n > 0)
+    execprefault(p, n, PTE_R);
 
   return filewrite(f, p, n);
 }
 
+uint64
+sys_ioctl(void)
+{
+  struct file *f;
+  int req, arg;
+
+  argint(1, &req);
+  argint(2, &arg);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return fileioctl(f, req, arg);
+}
+
 uint64
 sys_close(void)
 {
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  argint(0, &fd);
+  if((f = fdremove(myproc(), fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  if(f->type == FD_DEVICE && f->major == CONSOLE)
+    consolerelease(myproc()->pid);
   fileclose(f);
   return 0;
 }
@@ -341,7 +347,14 @@ sys_open(void)
     return -1;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+  // a running program can't be truncated; see iexecdup().
+  if((omode & O_TRUNC) && ip->type == T_FILE && ip->nexec > 0){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+
+  if((f = filealloc()) == 0 || (fd = fdalloc(myproc(), f)) < 0){
     if(f)
       fileclose(f);
     iunlockput(ip);
@@ -431,20 +444,28 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// free the strings fetchargv() copied.
+static void
+freeargv(char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
 
-  argaddr(1, &uargv);
-  if(argstr(0, path, MAXPATH) < 0) {
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
+    kfree(argv[i]);
+}
+
+// copy the user's argument array uargv, and the strings
+// it points to, into argv[MAXARG], a page per string.
+// returns 0, or -1 with nothing left to free.
+static int
+fetchargv(uint64 uargv, char **argv)
+{
+  int i;
+  uint64 uarg;
+
+  memset(argv, 0, MAXARG*sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -460,18 +481,56 @@ sys_exec(void)
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
       goto bad;
   }
+  return 0;
 
-  int ret = exec(path, argv);
+ bad:
+  freeargv(argv);
+  return -1;
+}
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
 
+  argaddr(1, &uargv);
+  if(argstr(0, path, MAXPATH) < 0) {
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  int ret = exec(path, argv);
+
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  int fdmap[NOFILE], nfd, ret;
+  uint64 uargv, ufdmap;
+
+  argaddr(1, &uargv);
+  argaddr(2, &ufdmap);
+  argint(3, &nfd);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  if(ufdmap != 0){
+    if(nfd < 0 || nfd > NOFILE ||
+       copyin(myproc()->pagetable, (char*)fdmap, ufdmap, nfd*sizeof(int)) < 0)
+      return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  ret = spawn(path, argv, ufdmap ? fdmap : 0, nfd);
+
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -486,17 +545,17 @@ sys_pipe(void)
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
+  if((fd0 = fdalloc(p, rf)) < 0 || (fd1 = fdalloc(p, wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdremove(p, fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdremove(p, fd0);
+    fdremove(p, fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
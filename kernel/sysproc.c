@@ -4,6 +4,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "sysinfo.h"
 
@@ -42,38 +43,147 @@ sys_wait(void)
 }
 
 uint64
-sys_sbrk(void)
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  argint(0, &tid);
+  argaddr(1, &p);
+  return join(tid, p);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 uaddr;
+  int op, val;
+
+  argaddr(0, &uaddr);
+  argint(1, &op);
+  argint(2, &val);
+  return futex(uaddr, op, val);
+}
+
+uint64
+sys_setaffinity(void)
+{
+  int pid;
+  uint64 mask;
+
+  argint(0, &pid);
+  argaddr(1, &mask);
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_cpustat(void)
 {
   uint64 addr;
   int n;
 
-  argint(0, &n);
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  argaddr(0, &addr);
+  argint(1, &n);
+  return cpustat(addr, n);
+}
+
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 addr;
+
+  argint(0, &who);
+  argaddr(1, &addr);
+  return getrusage(who, addr);
+}
+
+uint64
+sys_procstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return procstat(addr, n);
+}
+
+uint64
+sys_prof(void)
+{
+  int cmd, n;
+  uint64 arg;
+
+  argint(0, &cmd);
+  argaddr(1, &arg);
+  argint(2, &n);
+  return prof(cmd, arg, n);
+}
+
+// copy up to n return addresses from the caller's kernel
+// stack, as it is during this call, to the array addr.
+uint64
+sys_backtrace(void)
+{
+  uint64 addr, pcs[32];
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(n < 0)
     return -1;
-  return addr;
+  if(n > NELEM(pcs))
+    n = NELEM(pcs);
+  n = getcallerpcs(r_fp(), pcs, n);
+  if(copyout(myproc()->pagetable, addr, (char*)pcs, n * sizeof(pcs[0])) < 0)
+    return -1;
+  return n;
+}
+
+uint64
+sys_sbrk(void)
+{
+  int n;
+
+  argint(0, &n);
+  return growproc(n);
 }
 
 uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
   if(n < 0)
     n = 0;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return timersleep(r_time() + (uint64)n * TICKINTERVAL);
+}
+
+// sleep for a number of nanoseconds, with the
+// resolution of the time CSR rather than of ticks.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns, t;
+
+  argaddr(0, &ns);
+  t = ns / (1000000000 / TIMEBASE);
+  if(t == 0 && ns > 0)
+    t = 1;
+  return timersleep(r_time() + t);
 }
 
 uint64
@@ -90,12 +200,7 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return r_time() / TICKINTERVAL;
 }
 
 uint64
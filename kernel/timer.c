@@ -0,0 +1,205 @@
+// Tickless timer interrupts and sleeping until a deadline.
+//
+// There is no periodic clock interrupt. Each hart programs its
+// CLINT mtimecmp register for the next event it cares about:
+//  * while it runs a process, the end of the time slice, and
+//    the next sample if the profiler (prof.c) is on;
+//  * on hart 0, also the earliest deadline of a sleeping process.
+// A hart with neither sets no timer at all, so idle harts
+// are not woken ten times a second.
+//
+// timervec in kernelvec.S disables a hart's timer when it fires
+// and forwards a software interrupt to devintr(), which calls
+// clockintr() to wake expired sleepers and re-arm the timer.
+//
+// Times are in units of the time CSR (TIMEBASE per second).
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NEVER (~0UL)
+
+// processes sleeping until a deadline, sorted
+// earliest first and linked through p->tnext.
+// lock order: timerq.lock, then p->lock.
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} timerq;
+
+// protects every hart's mtimecmp register, cpu->timecmp,
+// and nextwake. never held while acquiring another lock.
+struct spinlock clocklock;
+uint64 nextwake = NEVER;   // copy of timerq.head->wakeat
+
+void
+timerqinit(void)
+{
+  initlock(&timerq.lock, "timerq");
+  initlock(&clocklock, "clock");
+}
+
+// set hart id's timer to fire at when.
+// caller must hold clocklock.
+static void
+setcmp(int id, uint64 when)
+{
+  cpus[id].timecmp = when;
+  *(uint64*)CLINT_MTIMECMP(id) = when;
+}
+
+// Program this hart's timer for the next event it cares about.
+// Interrupts must be disabled.
+void
+clockarm(void)
+{
+  struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 now = r_time(), when = NEVER, tick;
+
+  acquire(&clocklock);
+  if(c->proc){
+    if(c->sliceend <= now)
+      c->sliceend = now + QUANTUM;
+    when = c->sliceend;
+    if((tick = profinterval()) != 0 && now + tick < when)
+      when = now + tick;
+  }
+  if(id == 0 && nextwake < when)
+    when = nextwake;
+  setcmp(id, when);
+  release(&clocklock);
+}
+
+// The scheduler is about to run a process on this hart;
+// start a time slice, and make sure the hart's timer ends it.
+// Interrupts must be disabled.
+void
+clockslice(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now = r_time(), when, tick;
+
+  c->sliceend = now + QUANTUM;
+  when = c->sliceend;
+  if((tick = profinterval()) != 0 && now + tick < when)
+    when = now + tick;
+  if(c->timecmp <= when)
+    return;
+  acquire(&clocklock);
+  if(c->timecmp > when)
+    setcmp(cpuid(), when);
+  release(&clocklock);
+}
+
+// Timer interrupt on this hart.
+// Wake processes whose deadlines have passed, then re-arm.
+// Returns 1 if the running process should yield: its time
+// slice is over, or sleepers have woken. Returns 0 if the
+// interrupt was only for the profiler.
+int
+clockintr(void)
+{
+  void *chans[16];
+  struct proc *p;
+  uint64 now;
+  int i, n, woke, over;
+
+  woke = 0;
+  if(cpuid() == 0){
+    do {
+      // collect a batch of expired sleepers, and wake them
+      // after releasing timerq.lock, since wakeup()
+      // takes every p->lock.
+      n = 0;
+      acquire(&timerq.lock);
+      now = r_time();
+      while(n < NELEM(chans) && (p = timerq.head) != 0 && p->wakeat <= now){
+        timerq.head = p->tnext;
+        p->tnext = 0;
+        p->wakeat = 0;
+        chans[n++] = &p->wakeat;
+      }
+      acquire(&clocklock);
+      nextwake = timerq.head ? timerq.head->wakeat : NEVER;
+      release(&clocklock);
+      release(&timerq.lock);
+
+      for(i = 0; i < n; i++)
+        wakeup(chans[i]);
+      woke += n;
+    } while(n == NELEM(chans));
+  }
+
+  over = woke > 0 || mycpu()->sliceend <= r_time();
+  clockarm();
+  return over;
+}
+
+// remove p from timerq, if it is there.
+// caller must hold timerq.lock.
+static void
+timerq_remove(struct proc *p)
+{
+  struct proc **pp;
+
+  if(p->wakeat == 0)
+    return;
+  for(pp = &timerq.head; *pp; pp = &(*pp)->tnext){
+    if(*pp == p){
+      *pp = p->tnext;
+      break;
+    }
+  }
+  p->tnext = 0;
+  p->wakeat = 0;
+}
+
+// Sleep until the time CSR reaches deadline.
+// Returns 0, or -1 if the process was killed.
+int
+timersleep(uint64 deadline)
+{
+  struct proc *p = myproc();
+  struct proc **pp;
+
+  acquire(&timerq.lock);
+  if(r_time() >= deadline){
+    release(&timerq.lock);
+    return 0;
+  }
+
+  // insert in deadline order.
+  p->wakeat = deadline;
+  for(pp = &timerq.head; *pp && (*pp)->wakeat <= deadline; pp = &(*pp)->tnext)
+    ;
+  p->tnext = *pp;
+  *pp = p;
+
+  if(timerq.head == p){
+    // new earliest deadline; pull hart 0's timer in.
+    acquire(&clocklock);
+    nextwake = deadline;
+    if(deadline < cpus[0].timecmp)
+      setcmp(0, deadline);
+    release(&clocklock);
+  }
+
+  while(r_time() < deadline){
+    if(killed(p)){
+      timerq_remove(p);
+      release(&timerq.lock);
+      return -1;
+    }
+    sleep(&p->wakeat, &timerq.lock);
+  }
+  timerq_remove(p);
+  release(&timerq.lock);
+  return 0;
+}
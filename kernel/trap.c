@@ -3,12 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 
-struct spinlock tickslock;
-uint ticks;
-
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -19,7 +17,7 @@ extern int devintr();
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
+  timerqinit();
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -46,6 +44,11 @@ usertrap(void)
   w_stvec((uint64)kernelvec);
 
   struct proc *p = myproc();
+
+  // charge the time since usertrapret() to user mode.
+  uint64 now = r_time();
+  p->ru.utime += now - p->stamp;
+  p->stamp = now;
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -67,6 +70,17 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault: perhaps on a program page that
+    // exec() left to be loaded on first touch.
+    uint64 scause = r_scause(), va = r_stval();
+    int perm = scause == 12 ? PTE_X : scause == 13 ? PTE_R : PTE_W;
+    intr_on();
+    if(execfault(p->pagetable, va, perm) != 0){
+      printf("usertrap(): page fault scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, va);
+      setkilled(p);
+    }
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -90,12 +104,18 @@ void
 usertrapret(void)
 {
   struct proc *p = myproc();
+  uint64 now;
 
   // we're about to switch the destination of traps from
   // kerneltrap() to usertrap(), so turn off interrupts until
   // we're back in user space, where usertrap() is correct.
   intr_off();
 
+  // charge the time since usertrap() to the kernel.
+  now = r_time();
+  p->ru.stime += now - p->stamp;
+  p->stamp = now;
+
   // send syscalls, interrupts, and exceptions to uservec in trampoline.S
   uint64 trampoline_uservec = TRAMPOLINE + (uservec - trampoline);
   w_stvec(trampoline_uservec);
@@ -126,7 +146,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, p->trapva);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -144,6 +164,8 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
+  notestack();
+
   if((which_dev = devintr()) == 0){
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -160,19 +182,10 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
-void
-clockintr()
-{
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
-}
-
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
-// 1 if other device,
+// returns 2 if timer interrupt that ends the time slice,
+// 1 if other device or a profiler tick,
 // 0 if not recognized.
 int
 devintr()
@@ -202,18 +215,24 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or inter-processor interrupt, forwarded by timervec
+    // in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // if the timer has not fired, this was just a kick()
+    // to get the scheduler out of wfi.
+    if(mycpu()->timecmp > r_time())
+      return 1;
+
+    // sepc and sstatus still say where the hart was.
+    if(profinterval())
+      profsample(r_sepc(), (r_sstatus() & SSTATUS_SPP) == 0);
+
+    return clockintr() ? 2 : 1;
   } else {
     return 0;
   }
@@ -7,6 +7,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -27,6 +28,7 @@
 #define FCR 2                 // FIFO control register
 #define FCR_FIFO_ENABLE (1<<0)
 #define FCR_FIFO_CLEAR (3<<1) // clear the content of the two FIFOs
+#define FCR_TRIGGER_8 (2<<6)  // receive interrupt when 8 bytes are waiting
 #define ISR 2                 // interrupt status register
 #define LCR 3                 // line control register
 #define LCR_EIGHT_BITS (3<<0)
@@ -34,13 +36,14 @@
 #define LSR 5                 // line status register
 #define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
 #define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
+#define UART_FIFO_SIZE 16     // depth of the 16550a transmit FIFO
 
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
 // the transmit output buffer.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 1024
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
@@ -68,8 +71,10 @@ uartinit(void)
   // and set word length to 8 bits, no parity.
   WriteReg(LCR, LCR_EIGHT_BITS);
 
-  // reset and enable FIFOs.
-  WriteReg(FCR, FCR_FIFO_ENABLE | FCR_FIFO_CLEAR);
+  // reset and enable FIFOs. interrupt when the receive FIFO
+  // is half full, or when input pauses (character timeout),
+  // rather than for every byte.
+  WriteReg(FCR, FCR_FIFO_ENABLE | FCR_FIFO_CLEAR | FCR_TRIGGER_8);
 
   // enable transmit and receive interrupts.
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
@@ -104,6 +109,36 @@ uartputc(int c)
 }
 
 
+// add n characters to the output buffer, taking uart_tx_lock
+// once per buffer-full rather than once per character.
+// blocks while the output buffer is full, so,
+// like uartputc(), only suitable for use by write().
+void
+uartwrite(char *s, int n)
+{
+  int i = 0;
+
+  acquire(&uart_tx_lock);
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+  while(i < n){
+    while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      // buffer is full.
+      // wait for uartstart() to open up space in the buffer.
+      sleep(&uart_tx_r, &uart_tx_lock);
+    }
+    while(i < n && uart_tx_w < uart_tx_r + UART_TX_BUF_SIZE){
+      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = s[i++];
+      uart_tx_w += 1;
+    }
+    uartstart();
+  }
+  release(&uart_tx_lock);
+}
+
 // alternate version of uartputc() that doesn't 
 // use interrupts, for use by kernel printf() and
 // to echo characters. it spins waiting for the uart's
@@ -126,34 +161,36 @@ uartputc_sync(int c)
   pop_off();
 }
 
-// if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// if the UART is idle, and characters are waiting
+// in the transmit buffer, send them.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
 void
 uartstart()
 {
-  while(1){
-    if(uart_tx_w == uart_tx_r){
-      // transmit buffer is empty.
-      return;
-    }
-    
-    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
-      // the UART transmit holding register is full,
-      // so we cannot give it another byte.
-      // it will interrupt when it's ready for a new byte.
-      return;
-    }
-    
-    int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
+  int i;
+
+  if(uart_tx_w == uart_tx_r){
+    // transmit buffer is empty.
+    return;
+  }
+
+  if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+    // the UART transmit FIFO is still draining,
+    // so we cannot give it more bytes.
+    // it will interrupt when it's empty.
+    return;
+  }
+
+  // the transmit FIFO is empty, so it has room for
+  // a whole burst without checking LSR per byte.
+  for(i = 0; i < UART_FIFO_SIZE && uart_tx_r != uart_tx_w; i++){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
     uart_tx_r += 1;
-    
-    // maybe uartputc() is waiting for space in the buffer.
-    wakeup(&uart_tx_r);
-    
-    WriteReg(THR, c);
   }
+
+  // maybe uartputc() or uartwrite() is waiting for space in the buffer.
+  wakeup(&uart_tx_r);
 }
 
 // read one input character from the UART.
@@ -175,13 +212,17 @@ uartgetc(void)
 void
 uartintr(void)
 {
-  // read and process incoming characters.
-  while(1){
-    int c = uartgetc();
-    if(c == -1)
-      break;
-    consoleintr(c);
-  }
+  char buf[UART_FIFO_SIZE];
+  int c, n;
+
+  // drain the receive FIFO, handing incoming
+  // characters to the console a batch at a time.
+  do {
+    for(n = 0; n < sizeof(buf) && (c = uartgetc()) != -1; n++)
+      buf[n] = c;
+    if(n > 0)
+      consoleintr(buf, n);
+  } while(n == sizeof(buf));
 
   // send buffered characters.
   acquire(&uart_tx_lock);
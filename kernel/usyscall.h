@@ -0,0 +1,15 @@
+// pages the kernel maps read-only into every process, so
+// that programs can read a few facts without a system call.
+
+// at USYSCALL: one per address space.
+struct usyscall {
+  int pid;          // of the process that owns it
+  int threaded;     // clone() has shared the address space, so
+                    // pid may not be the caller's; ask getpid()
+};
+
+// at KINFO: the same page in every process.
+struct kinfo {
+  uint64 freemem;   // free memory (bytes), as sysinfo() reports
+  uint64 nproc;     // processes, as sysinfo() reports
+};
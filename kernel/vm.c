@@ -27,6 +27,9 @@ kvmmake(void)
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, so the kernel can program each hart's timer.
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
@@ -42,9 +45,6 @@ kvmmake(void)
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
-
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
   
   return kpgtbl;
 }
@@ -165,8 +165,10 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned. The mappings must exist, or be program
+// pages that execfault() has not loaded yet (PTE_L).
+// Optionally free the physical memory; shared (PTE_S)
+// pages go back to the page cache.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
@@ -179,13 +181,20 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if((*pte & PTE_V) == 0){
+      if((*pte & PTE_L) == 0)
+        panic("uvmunmap: not mapped");
+      *pte = 0;
+      continue;
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
       uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      if(*pte & PTE_S)
+        pcache_put(pa);
+      else
+        kfree((void*)pa);
     }
     *pte = 0;
   }
@@ -248,6 +257,28 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
   return newsz;
 }
 
+// Grow a process from oldsz to newsz with program pages for
+// execfault() to load when first touched: their PTEs are
+// invalid, and hold just PTE_L. Returns newsz, or 0 if out
+// of memory for page-table pages.
+uint64
+uvmlazy(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
+{
+  uint64 a;
+  pte_t *pte;
+
+  for(a = PGROUNDUP(oldsz); a < newsz; a += PGSIZE){
+    if((pte = walk(pagetable, a, 1)) == 0){
+      uvmdealloc(pagetable, a, oldsz);
+      return 0;
+    }
+    if(*pte & PTE_V)
+      panic("uvmlazy: remap");
+    *pte = PTE_L;
+  }
+  return newsz;
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
@@ -305,7 +336,7 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
   char *mem;
@@ -313,10 +344,24 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
       panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((*pte & PTE_V) == 0){
+      if((*pte & PTE_L) == 0)
+        panic("uvmcopy: page not present");
+      // not yet loaded by execfault(); nor is the child's.
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      *npte = PTE_L;
+      continue;
+    }
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if(flags & PTE_S){
+      // read-only program text: share the cached page.
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      pcache_dup(pa);
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -345,6 +390,38 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Translate the user page va0 for copyin()/copyout()/copyinstr(),
+// which touch consecutive pages. *last remembers the PTE of the
+// previous page; when va0 is the page after it and both lie in
+// the same leaf page-table page, the next PTE is simply the
+// next slot, and the three-level walk() is skipped.
+// A program page exec() has not loaded yet is faulted in,
+// unless the caller holds a spinlock.
+// Return the physical address, or 0 if not a user page
+// mapped with perm.
+static uint64
+uvmnext(pagetable_t pagetable, uint64 va0, pte_t **last, int perm)
+{
+  pte_t *pte;
+
+  if(va0 >= MAXVA)
+    return 0;
+  if(*last != 0 && PX(0, va0) != 0)
+    pte = *last + 1;
+  else
+    pte = walk(pagetable, va0, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0){
+    if(holdingany() || execfault(pagetable, va0, perm) != 0)
+      return 0;
+    if((pte = walk(pagetable, va0, 0)) == 0)
+      return 0;
+  }
+  *last = pte;
+  if((*pte & PTE_U) == 0 || (*pte & perm) != perm)
+    return 0;
+  return PTE2PA(*pte);
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -352,10 +429,11 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *last = 0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmnext(pagetable, va0, &last, PTE_W);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -377,10 +455,11 @@ int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *last = 0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmnext(pagetable, va0, &last, PTE_R);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -395,6 +474,9 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   return 0;
 }
 
+// does the 64-bit word v contain a zero byte?
+#define HASZERO(v) (((v) - 0x0101010101010101UL) & ~(v) & 0x8080808080808080UL)
+
 // Copy a null-terminated string from user to kernel.
 // Copy bytes to dst from virtual address srcva in a given page table,
 // until a '\0', or max.
@@ -404,10 +486,11 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
   uint64 n, va0, pa0;
   int got_null = 0;
+  pte_t *last = 0;
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmnext(pagetable, va0, &last, PTE_R);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -416,6 +499,19 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
     char *p = (char *) (pa0 + (srcva - va0));
     while(n > 0){
+      // a word at a time, while source and destination are
+      // both aligned and the word holds no terminator.
+      if((((uint64)p | (uint64)dst) & 7) == 0 && n >= 8){
+        uint64 w = *(uint64*)p;
+        if(HASZERO(w) == 0){
+          *(uint64*)dst = w;
+          n -= 8;
+          max -= 8;
+          p += 8;
+          dst += 8;
+          continue;
+        }
+      }
       if(*p == '\0'){
         *dst = '\0';
         got_null = 1;
@@ -0,0 +1,336 @@
+// Benchmarks of basic kernel operations, for comparing one
+// build with another. Each benchmark does a fixed round of
+// work over and over until at least MINTIME has passed, then
+// prints one line:
+//
+//   bench: <name> <value> <unit> <ops> <usecs>
+//
+// value is the time per operation for latencies, and the
+// operations or bytes per second for rates. ops and usecs
+// are the totals it was worked out from. "bench: done"
+// follows the last line. make bench runs this under QEMU
+// and collects the lines into bench.out.
+//
+// usage: bench [name ...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define MINTIME  (2*TIMEBASE)   // run each benchmark at least this long
+#define PAGE     4096
+#define FILEKB   256            // fits in a file; see MAXFILE
+#define PIPEKB   1024           // per round through a pipe
+#define NSMALL   16             // small files per round
+
+// how each benchmark reports
+#define NS    1   // ns per op
+#define US    2   // us per op
+#define RATE  3   // ops per second
+#define KBPS  4   // ops are bytes; KB per second
+
+char *prog;       // how this program was run, for exec()
+char buf[PAGE];
+
+// the time, in units of the time CSR.
+uint64
+now(void)
+{
+  return rdtime();
+}
+
+void
+fail(char *what)
+{
+  fprintf(2, "bench: %s failed\n", what);
+  exit(1);
+}
+
+// Each round does some operations and returns how many.
+
+uint64
+getpidround(void)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    getpid();
+  return 1000;
+}
+
+uint64
+getpidsysround(void)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    _getpid();
+  return 1000;
+}
+
+uint64
+uptimeround(void)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    uptime();
+  return 1000;
+}
+
+uint64
+rdtimeround(void)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    rdtime();
+  return 1000;
+}
+
+uint64
+forkround(void)
+{
+  int i, pid;
+
+  for(i = 0; i < 10; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  return 10;
+}
+
+// fork, then exec this program, which exits at once.
+uint64
+execround(void)
+{
+  char *argv[] = { prog, "-x", 0 };
+  int i, pid;
+
+  for(i = 0; i < 10; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0){
+      exec(prog, argv);
+      fail("exec");
+    }
+    wait(0);
+  }
+  return 10;
+}
+
+uint64
+spawnround(void)
+{
+  char *argv[] = { prog, "-x", 0 };
+  int fds[3] = { 0, 1, 2 };
+  int i;
+
+  for(i = 0; i < 10; i++){
+    if(spawn(prog, argv, fds, 3) < 0)
+      fail("spawn");
+    wait(0);
+  }
+  return 10;
+}
+
+// a child writes PIPEKB to the parent.
+uint64
+piperound(void)
+{
+  int p[2], n, got;
+
+  if(pipe(p) < 0)
+    fail("pipe");
+  int pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    close(p[0]);
+    for(n = 0; n < PIPEKB*1024; n += sizeof(buf))
+      if(write(p[1], buf, sizeof(buf)) != sizeof(buf))
+        fail("pipe write");
+    exit(0);
+  }
+  close(p[1]);
+  got = 0;
+  while((n = read(p[0], buf, sizeof(buf))) > 0)
+    got += n;
+  close(p[0]);
+  wait(0);
+  if(got != PIPEKB*1024)
+    fail("pipe read");
+  return got;
+}
+
+// create, write and close NSMALL small files, then delete them.
+uint64
+fileround(void)
+{
+  char name[] = "benchf00";
+  int i, fd;
+
+  for(i = 0; i < NSMALL; i++){
+    name[6] = '0' + i / 10;
+    name[7] = '0' + i % 10;
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0)
+      fail("create");
+    if(write(fd, buf, 64) != 64)
+      fail("write");
+    close(fd);
+  }
+  for(i = 0; i < NSMALL; i++){
+    name[6] = '0' + i / 10;
+    name[7] = '0' + i % 10;
+    if(unlink(name) < 0)
+      fail("unlink");
+  }
+  return NSMALL;
+}
+
+uint64
+writeround(void)
+{
+  int fd, n;
+
+  if((fd = open("benchfile", O_CREATE|O_TRUNC|O_WRONLY)) < 0)
+    fail("create");
+  for(n = 0; n < FILEKB*1024; n += sizeof(buf))
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  close(fd);
+  return n;
+}
+
+uint64
+readround(void)
+{
+  int fd, n, got;
+
+  if((fd = open("benchfile", O_RDONLY)) < 0)
+    fail("open");
+  got = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    got += n;
+  close(fd);
+  if(got != FILEKB*1024)
+    fail("read");
+  return got;
+}
+
+// grow the heap a page at a time, touching each
+// page, then give it all back.
+uint64
+sbrkround(void)
+{
+  char *p;
+  int i;
+
+  for(i = 0; i < 256; i++){
+    if((p = sbrk(PAGE)) == (char*)-1)
+      fail("sbrk");
+    *p = 1;
+  }
+  if(sbrk(-256*PAGE) == (char*)-1)
+    fail("sbrk");
+  return 256;
+}
+
+void
+mkbenchfile(void)
+{
+  writeround();
+}
+
+void
+rmbenchfile(void)
+{
+  unlink("benchfile");
+}
+
+struct bench {
+  char *name;
+  uint64 (*round)(void);
+  int kind;
+  char *unit;
+  void (*setup)(void);
+  void (*cleanup)(void);
+} benches[] = {
+  { "getpid",     getpidround, NS,   "ns/op",   0, 0 },
+  { "getpid-sys", getpidsysround, NS, "ns/op",  0, 0 },
+  { "uptime",     uptimeround, NS,   "ns/op",   0, 0 },
+  { "rdtime",     rdtimeround, NS,   "ns/op",   0, 0 },
+  { "fork-wait",  forkround,   US,   "us/op",   0, 0 },
+  { "exec-wait",  execround,   US,   "us/op",   0, 0 },
+  { "spawn-wait", spawnround,  US,   "us/op",   0, 0 },
+  { "pipe",       piperound,   KBPS, "KB/s",    0, 0 },
+  { "smallfile",  fileround,   RATE, "files/s", 0, 0 },
+  { "write",      writeround,  KBPS, "KB/s",    0, rmbenchfile },
+  { "read",       readround,   KBPS, "KB/s",    mkbenchfile, rmbenchfile },
+  { "sbrk",       sbrkround,   RATE, "pages/s", 0, 0 },
+};
+#define NBENCH (sizeof(benches)/sizeof(benches[0]))
+
+void
+run(struct bench *b)
+{
+  uint64 ops, t, t0, v;
+
+  if(b->setup)
+    b->setup();
+  ops = 0;
+  t0 = now();
+  do {
+    ops += b->round();
+  } while((t = now() - t0) < MINTIME);
+  if(b->cleanup)
+    b->cleanup();
+
+  switch(b->kind){
+  case NS:
+    v = t * (1000000000 / TIMEBASE) / ops;
+    break;
+  case US:
+    v = t / (TIMEBASE / 1000000) / ops;
+    break;
+  case RATE:
+    v = ops * TIMEBASE / t;
+    break;
+  default:
+    v = ops / 1024 * TIMEBASE / t;
+    break;
+  }
+  printf("bench: %s %l %s %l %l\n", b->name, v, b->unit, ops,
+         t / (TIMEBASE / 1000000));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct stat st;
+  int i, j;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);   // exec-wait and spawn-wait run this
+  prog = argv[0];
+  if(stat(prog, &st) < 0)
+    prog = "/bench";   // sh found it in /
+  memset(buf, 'x', sizeof(buf));
+
+  for(i = 0; i < NBENCH; i++){
+    if(argc == 1){
+      run(&benches[i]);
+      continue;
+    }
+    for(j = 1; j < argc; j++)
+      if(strcmp(argv[j], benches[i].name) == 0)
+        run(&benches[i]);
+  }
+  printf("bench: done\n");
+  exit(0);
+}
@@ -3,20 +3,18 @@
 #include "kernel/fcntl.h"
 #include "user/user.h"
 
-char buf[512];
-
 void
-cat(int fd)
+cat(FILE *f)
 {
-  int n;
+  int c;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
+  while((c = fgetc(f)) != EOF){
+    if(fputc(c, stdout) == EOF){
       fprintf(2, "cat: write error\n");
       exit(1);
     }
   }
-  if(n < 0){
+  if(ferror(f)){
     fprintf(2, "cat: read error\n");
     exit(1);
   }
@@ -25,20 +23,21 @@ cat(int fd)
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  FILE *f;
+  int i;
 
   if(argc <= 1){
-    cat(0);
+    cat(stdin);
     exit(0);
   }
 
   for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], O_RDONLY)) < 0){
+    if((f = fopen(argv[i], "r")) == 0){
       fprintf(2, "cat: cannot open %s\n", argv[i]);
       exit(1);
     }
-    cat(fd);
-    close(fd);
+    cat(f);
+    fclose(f);
   }
   exit(0);
 }
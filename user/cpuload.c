@@ -0,0 +1,56 @@
+// Show how busy each CPU is, to spot load imbalance.
+// Samples the kernel's per-CPU counters every interval
+// and prints each CPU's busy percentage and the number of
+// processes it ran in that time.
+//
+// usage: cpuload [seconds [count]]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/cpustat.h"
+#include "user/user.h"
+
+struct cpustat prev[NCPU], cur[NCPU];
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, secs, count, pct;
+  uint64 busy, idle;
+
+  secs = argc > 1 ? atoi(argv[1]) : 1;
+  count = argc > 2 ? atoi(argv[2]) : 5;
+  if(secs <= 0 || count <= 0){
+    fprintf(2, "usage: cpuload [seconds [count]]\n");
+    exit(1);
+  }
+
+  if((n = cpustat(prev, NCPU)) < 0){
+    fprintf(2, "cpuload: cpustat failed\n");
+    exit(1);
+  }
+  if(n > NCPU)
+    n = NCPU;
+
+  while(count-- > 0){
+    nanosleep((uint64)secs * 1000000000);
+    if(cpustat(cur, n) < 0){
+      fprintf(2, "cpuload: cpustat failed\n");
+      exit(1);
+    }
+    for(i = 0; i < n; i++){
+      if(!cur[i].online)
+        continue;
+      if(i > 0)
+        printf("  ");
+      busy = cur[i].busy - prev[i].busy;
+      idle = cur[i].idle - prev[i].idle;
+      pct = busy + idle > 0 ? busy * 100 / (busy + idle) : 0;
+      printf("cpu%d %d%% busy, %d runs", i, pct, (int)(cur[i].nswtch - prev[i].nswtch));
+    }
+    printf("\n");
+    memmove(prev, cur, sizeof(cur));
+  }
+  exit(0);
+}
@@ -1,107 +1,249 @@
 // Simple grep.  Only supports ^ . * $ operators.
+//
+// usage: grep [-cnv] pattern [file ...]
+//   -c  print only a count of the matching lines
+//   -n  print each line's number before it
+//   -v  select the lines that do not match
+//
+// The pattern is compiled to an NFA whose states are positions
+// in the pattern, so a set of them fits in a uint64. A DFA is
+// built from it lazily, one state and one input byte at a time,
+// so each byte of input costs a table lookup however the
+// pattern is written. When the pattern starts with a plain
+// character, lines that lack it are skipped with memchr().
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
 #include "user/user.h"
 
-char buf[1024];
-int match(char*, char*);
+#define NATOM    63     // pattern atoms; positions 0..NATOM fit a uint64
+#define NDSTATE  64     // cached DFA states
+#define ANY      (-1)   // atom that matches any byte
+
+struct atom {
+  int c;                // byte to match, or ANY
+  int star;             // zero or more of them
+} atoms[NATOM];
+int natom;
+int bol, eol;           // pattern began with ^, ended with $
+uint64 eps[NATOM+1];    // positions reachable from each by skipping starred atoms
+
+struct dstate {
+  uint64 set;           // NFA positions; bit natom means matched
+  short next[256];      // next state for each byte, or -1 if not yet built
+} dstates[NDSTATE];
+int ndstate;
+int dstart;
+
+int cflag, nflag, vflag;
+char buf[32*1024];
 
 void
-grep(char *pattern, int fd)
+compile(char *re)
 {
-  int n, m;
-  char *p, *q;
+  int i;
 
-  m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
-    m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
+  if(re[0] == '^'){
+    bol = 1;
+    re++;
+  }
+  for(natom = 0; *re; natom++){
+    if(re[0] == '$' && re[1] == '\0'){
+      eol = 1;
+      break;
     }
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
+    if(natom == NATOM){
+      fprintf(2, "grep: pattern too long\n");
+      exit(1);
     }
+    atoms[natom].c = re[0] == '.' ? ANY : (uchar)re[0];
+    atoms[natom].star = re[1] == '*';
+    re += atoms[natom].star ? 2 : 1;
   }
+
+  // a position can skip past any starred atoms that follow it.
+  eps[natom] = 1UL << natom;
+  for(i = natom - 1; i >= 0; i--)
+    eps[i] = (1UL << i) | (atoms[i].star ? eps[i+1] : 0);
 }
 
+// find or make the DFA state for NFA set s. when the cache
+// is full, start over; earlier state numbers are then stale.
 int
-main(int argc, char *argv[])
+dstate(uint64 s)
 {
-  int fd, i;
-  char *pattern;
+  int i;
 
-  if(argc <= 1){
-    fprintf(2, "usage: grep pattern [file ...]\n");
-    exit(1);
+  for(i = 0; i < ndstate; i++)
+    if(dstates[i].set == s)
+      return i;
+  if(ndstate == NDSTATE){
+    ndstate = 0;
+    dstart = dstate(eps[0]);
   }
-  pattern = argv[1];
+  i = ndstate++;
+  dstates[i].set = s;
+  memset(dstates[i].next, 0xff, sizeof(dstates[i].next));
+  return i;
+}
 
-  if(argc <= 2){
-    grep(pattern, 0);
-    exit(0);
+// the state after state d reads byte c.
+int
+dnext(int d, int c)
+{
+  uint64 s = dstates[d].set, t = 0;
+  int i, n;
+
+  for(i = 0; i < natom; i++){
+    if((s & (1UL << i)) == 0)
+      continue;
+    if(atoms[i].c == ANY || atoms[i].c == c)
+      t |= atoms[i].star ? eps[i] : eps[i+1];
   }
+  if(!bol)
+    t |= eps[0];   // a match may start at any byte
+  n = dstate(t);
+  if(dstates[d].set == s)   // not flushed by dstate()
+    dstates[d].next[c] = n;
+  return n;
+}
 
-  for(i = 2; i < argc; i++){
-    if((fd = open(argv[i], O_RDONLY)) < 0){
-      printf("grep: cannot open %s\n", argv[i]);
-      exit(1);
-    }
-    grep(pattern, fd);
-    close(fd);
+// does the line [p, e) match?
+int
+matchline(char *p, char *e)
+{
+  uint64 acc = 1UL << natom;
+  int d = dstart, n;
+
+  for(; p < e; p++){
+    if(!eol && (dstates[d].set & acc))
+      return 1;
+    if(dstates[d].set == 0)
+      return 0;
+    if((n = dstates[d].next[(uchar)*p]) < 0)
+      n = dnext(d, (uchar)*p);
+    d = n;
   }
-  exit(0);
+  return (dstates[d].set & acc) != 0;
 }
 
-// Regexp matcher from Kernighan & Pike,
-// The Practice of Programming, Chapter 9, or
-// https://www.cs.princeton.edu/courses/archive/spr09/cos333/beautiful.html
+// handle the lines in [p, e). if more input may follow,
+// leave the unfinished last line and return where it starts.
+char*
+scan(char *p, char *e, int last, int *lineno, int *count)
+{
+  char *q, *nl;
+  int quick = !bol && !vflag && natom > 0 &&
+              atoms[0].c != ANY && !atoms[0].star;
 
-int matchhere(char*, char*);
-int matchstar(int, char*, char*);
+  while(p < e){
+    if(quick){
+      // a matching line holds atoms[0].c; skip to the
+      // first line that does.
+      if((q = memchr(p, atoms[0].c, e - p)) == 0)
+        q = e;
+      for(nl = q; nl > p && nl[-1] != '\n'; nl--)
+        ;
+      if(nflag)
+        for(; p < nl; p++)
+          if(*p == '\n')
+            (*lineno)++;
+      p = nl;
+      if(q == e)
+        return last ? e : p;
+    }
+    if((nl = memchr(p, '\n', e - p)) == 0){
+      if(!last)
+        return p;
+      nl = e;
+    }
+    (*lineno)++;
+    if(matchline(p, nl) != vflag){
+      (*count)++;
+      if(!cflag){
+        if(nflag)
+          printf("%d:", *lineno);
+        fwrite(p, 1, nl - p, stdout);
+        fputc('\n', stdout);
+      }
+    }
+    p = nl + 1;
+  }
+  return e;
+}
 
+// returns the number of matching lines.
 int
-match(char *re, char *text)
+grep(int fd)
 {
-  if(re[0] == '^')
-    return matchhere(re+1, text);
-  do{  // must look at empty string
-    if(matchhere(re, text))
-      return 1;
-  }while(*text++ != '\0');
-  return 0;
+  int n, m, lineno, count;
+  char *p;
+
+  m = lineno = count = 0;
+  while((n = read(fd, buf + m, sizeof(buf) - m)) > 0){
+    m += n;
+    p = scan(buf, buf + m, 0, &lineno, &count);
+    if(p == buf && m == sizeof(buf))
+      p = scan(buf, buf + m, 1, &lineno, &count);   // overlong line
+    m -= p - buf;
+    memmove(buf, p, m);
+  }
+  if(n < 0)
+    fprintf(2, "grep: read error\n");
+  scan(buf, buf + m, 1, &lineno, &count);
+  return count;
 }
 
-// matchhere: search for re at beginning of text
-int matchhere(char *re, char *text)
+void
+usage(void)
 {
-  if(re[0] == '\0')
-    return 1;
-  if(re[1] == '*')
-    return matchstar(re[0], re+2, text);
-  if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
-    return matchhere(re+1, text+1);
-  return 0;
+  fprintf(2, "usage: grep [-cnv] pattern [file ...]\n");
+  exit(1);
 }
 
-// matchstar: search for c*re at beginning of text
-int matchstar(int c, char *re, char *text)
+int
+main(int argc, char *argv[])
 {
-  do{  // a * matches zero or more instances
-    if(matchhere(re, text))
-      return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
-  return 0;
-}
+  int fd, i, n, nfile;
+  char *s;
 
+  for(i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++){
+    for(s = argv[i] + 1; *s; s++){
+      if(*s == 'c')
+        cflag = 1;
+      else if(*s == 'n')
+        nflag = 1;
+      else if(*s == 'v')
+        vflag = 1;
+      else
+        usage();
+    }
+  }
+  if(i >= argc)
+    usage();
+  compile(argv[i++]);
+  dstart = dstate(eps[0]);
+
+  if(i >= argc){
+    n = grep(0);
+    if(cflag)
+      printf("%d\n", n);
+    exit(0);
+  }
+
+  nfile = argc - i;
+  for(; i < argc; i++){
+    if((fd = open(argv[i], O_RDONLY)) < 0){
+      printf("grep: cannot open %s\n", argv[i]);
+      exit(1);
+    }
+    n = grep(fd);
+    close(fd);
+    if(cflag && nfile > 1)
+      printf("%s:%d\n", argv[i], n);
+    else if(cflag)
+      printf("%d\n", n);
+  }
+  exit(0);
+}
@@ -0,0 +1,107 @@
+// Measure grep over several MB of text, piped to it since
+// files are limited to 268 KB: a literal that lets grep skip
+// lines with memchr(), patterns that need the DFA on every
+// byte, and one that makes a backtracking matcher take time
+// exponential in the number of stars.
+//
+// usage: grepbench [mbytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define CHUNK (64*1024)
+
+char text[CHUNK];
+char *patterns[] = {
+  "needle",
+  "^a.*z$",
+  "e.*d.*l",
+  "a*a*a*a*a*a*a*a*a*a*b",
+};
+#define NPAT (sizeof(patterns)/sizeof(patterns[0]))
+
+// fill text with lines of random lowercase words,
+// with an occasional needle.
+void
+gentext(void)
+{
+  uint seed = 1;
+  int i, col;
+
+  col = 0;
+  for(i = 0; i < CHUNK; i++){
+    seed = seed * 1103515245 + 12345;
+    if(col > 20 && (seed >> 16) % 16 == 0){
+      text[i] = '\n';
+      col = 0;
+    } else if((seed >> 16) % 6 == 0){
+      text[i] = ' ';
+      col++;
+    } else {
+      text[i] = 'a' + (seed >> 16) % 26;
+      col++;
+    }
+  }
+  text[CHUNK-1] = '\n';
+  memmove(text + 100, "needle", 6);
+}
+
+// run grep -c pattern over mb MB of text, and report
+// how long it took.
+void
+run(char *pattern, int mb)
+{
+  char *argv[] = { "grep", "-c", pattern, 0 };
+  char out[32];
+  int p[2], q[2], fds[3], i, n, t0, t;
+
+  if(pipe(p) < 0 || pipe(q) < 0){
+    fprintf(2, "grepbench: pipe failed\n");
+    exit(1);
+  }
+  fds[0] = p[0];
+  fds[1] = q[1];
+  fds[2] = 2;
+  t0 = uptime();
+  if(spawn("grep", argv, fds, 3) < 0){
+    fprintf(2, "grepbench: cannot run grep\n");
+    exit(1);
+  }
+  close(p[0]);
+  close(q[1]);
+  for(i = 0; i < mb * (1024*1024 / CHUNK); i++)
+    if(write(p[1], text, CHUNK) != CHUNK){
+      fprintf(2, "grepbench: write failed\n");
+      exit(1);
+    }
+  close(p[1]);
+  n = read(q[0], out, sizeof(out) - 1);
+  close(q[0]);
+  wait(0);
+  t = uptime() - t0;
+  if(n <= 0){
+    fprintf(2, "grepbench: no count from grep\n");
+    exit(1);
+  }
+  out[n] = 0;
+  printf("grepbench: %s: %d ticks, matched %s", pattern, t, out);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, mb = 4;
+
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(mb <= 0){
+    fprintf(2, "usage: grepbench [mbytes]\n");
+    exit(1);
+  }
+  gentext();
+  printf("grepbench: %d MB\n", mb);
+  for(i = 0; i < NPAT; i++)
+    run(patterns[i], mb);
+  exit(0);
+}
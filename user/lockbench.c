@@ -0,0 +1,163 @@
+// Contended-lock benchmark for threads made by clone():
+// each of 1, 2, ... threads bumps a shared counter under
+// a lock, which is a pure spin lock, a futex-backed mutex,
+// or a token passed through a pipe. Then two threads
+// ping-pong through a condition variable.
+//
+// usage: lockbench [maxthreads [iterations]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXT 8
+#define STACKSZ 4096
+
+enum { SPIN, MUTEX, PIPE, NMODE };
+char *modes[] = { "spin", "mutex", "pipe" };
+
+int mode, iters;
+volatile int spin;
+struct mutex mu;
+int token[2];
+volatile long counter;
+char *stacks[MAXT];
+
+void
+lock(void)
+{
+  char c;
+
+  switch(mode){
+  case SPIN:
+    while(__sync_lock_test_and_set(&spin, 1) != 0)
+      ;
+    break;
+  case MUTEX:
+    mutex_lock(&mu);
+    break;
+  case PIPE:
+    read(token[0], &c, 1);
+    break;
+  }
+}
+
+void
+unlock(void)
+{
+  switch(mode){
+  case SPIN:
+    __sync_lock_release(&spin);
+    break;
+  case MUTEX:
+    mutex_unlock(&mu);
+    break;
+  case PIPE:
+    write(token[1], "t", 1);
+    break;
+  }
+}
+
+void
+worker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < iters; i++){
+    lock();
+    counter++;
+    unlock();
+  }
+}
+
+// run nt workers; returns elapsed ticks.
+int
+run(int nt)
+{
+  int i, t0, tids[MAXT];
+
+  counter = 0;
+  t0 = uptime();
+  for(i = 0; i < nt; i++){
+    if((tids[i] = thread_create(worker, 0, stacks[i], STACKSZ)) < 0){
+      fprintf(2, "lockbench: thread_create failed\n");
+      exit(1);
+    }
+  }
+  for(i = 0; i < nt; i++)
+    join(tids[i], 0);
+  if(counter != (long)nt * iters){
+    fprintf(2, "lockbench: %s: counter %d, want %d\n",
+            modes[mode], (int)counter, nt * iters);
+    exit(1);
+  }
+  return uptime() - t0;
+}
+
+// ping-pong: two threads take turns, handing over
+// through a condition variable.
+struct cond turncv;
+volatile int turn;
+
+void
+player(void *arg)
+{
+  int me = (int)(uint64)arg;
+  int i;
+
+  for(i = 0; i < iters; i++){
+    mutex_lock(&mu);
+    while(turn != me)
+      cond_wait(&turncv, &mu);
+    turn = !me;
+    cond_signal(&turncv);
+    mutex_unlock(&mu);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, nt, maxt, t, tids[2];
+
+  maxt = argc > 1 ? atoi(argv[1]) : 4;
+  iters = argc > 2 ? atoi(argv[2]) : 20000;
+  if(maxt < 1 || maxt > MAXT || iters <= 0){
+    fprintf(2, "usage: lockbench [maxthreads (1-%d) [iterations]]\n", MAXT);
+    exit(1);
+  }
+  // ping-pong needs two.
+  for(i = 0; i < maxt || i < 2; i++)
+    if((stacks[i] = malloc(STACKSZ)) == 0){
+      fprintf(2, "lockbench: out of memory\n");
+      exit(1);
+    }
+  if(pipe(token) < 0){
+    fprintf(2, "lockbench: pipe failed\n");
+    exit(1);
+  }
+  write(token[1], "t", 1);
+  mutex_init(&mu);
+
+  for(mode = 0; mode < NMODE; mode++){
+    for(nt = 1; nt <= maxt; nt++){
+      t = run(nt);
+      printf("lockbench: %s %d threads: %d ops in %d ticks",
+             modes[mode], nt, nt * iters, t);
+      if(t > 0)
+        printf(", %d ops/tick", nt * iters / t);
+      printf("\n");
+    }
+  }
+
+  cond_init(&turncv);
+  turn = 0;
+  t = uptime();
+  for(i = 0; i < 2; i++)
+    tids[i] = thread_create(player, (void*)(uint64)i, stacks[i], STACKSZ);
+  for(i = 0; i < 2; i++)
+    join(tids[i], 0);
+  t = uptime() - t;
+  printf("lockbench: condvar ping-pong: %d round trips in %d ticks\n", iters, t);
+  exit(0);
+}
@@ -0,0 +1,140 @@
+// Measure malloc() and free(): a churn of small objects of
+// mixed sizes, a pattern that fragments a first-fit heap,
+// repeated allocation of large blocks, and growing a buffer
+// with realloc(). Also reports whether freeing the large
+// blocks gave their memory back to the kernel.
+//
+// usage: mallocbench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NSLOT 1000
+
+void *slot[NSLOT];
+uint seed = 1;
+
+uint
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) & 0xffffff;
+}
+
+void
+fail(char *what)
+{
+  fprintf(2, "mallocbench: %s failed\n", what);
+  exit(1);
+}
+
+// replace random slots with objects of 1 to max bytes.
+int
+churn(int n, int max)
+{
+  int i, j, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    j = rnd() % NSLOT;
+    free(slot[j]);
+    if((slot[j] = malloc(1 + rnd() % max)) == 0)
+      fail("malloc");
+  }
+  for(j = 0; j < NSLOT; j++){
+    free(slot[j]);
+    slot[j] = 0;
+  }
+  return uptime() - t0;
+}
+
+// fill every slot, free every other one, then allocate
+// objects slightly bigger than the holes left behind.
+int
+holes(int n)
+{
+  int i, j, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    for(j = 0; j < NSLOT; j++)
+      if((slot[j] = malloc(24)) == 0)
+        fail("malloc");
+    for(j = 0; j < NSLOT; j += 2){
+      free(slot[j]);
+      slot[j] = 0;
+    }
+    for(j = 0; j < NSLOT; j += 2)
+      if((slot[j] = malloc(40)) == 0)
+        fail("malloc");
+    for(j = 0; j < NSLOT; j++){
+      free(slot[j]);
+      slot[j] = 0;
+    }
+  }
+  return uptime() - t0;
+}
+
+// allocate and free blocks of 16 to 256 KB.
+int
+large(int n)
+{
+  int i, j, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    for(j = 0; j < 8; j++)
+      if((slot[j] = malloc((16 << (j % 5)) * 1024)) == 0)
+        fail("large malloc");
+    for(j = 7; j >= 0; j--){
+      free(slot[j]);
+      slot[j] = 0;
+    }
+  }
+  return uptime() - t0;
+}
+
+// grow a buffer to 512 KB, 1 KB at a time.
+int
+grow(int n)
+{
+  int i, k, t0;
+  char *b;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    b = 0;
+    for(k = 1; k <= 512; k++){
+      if((b = realloc(b, k * 1024)) == 0)
+        fail("realloc");
+      b[k * 1024 - 1] = k;
+    }
+    free(b);
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 10;
+  char *top0, *top1;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    fprintf(2, "usage: mallocbench [rounds]\n");
+    exit(1);
+  }
+
+  printf("mallocbench: small churn: %d ticks\n", churn(rounds * 10000, 512));
+  printf("mallocbench: holes: %d ticks\n", holes(rounds * 10));
+  top0 = sbrk(0);
+  printf("mallocbench: large: %d ticks\n", large(rounds * 10));
+  top1 = sbrk(0);
+  printf("mallocbench: realloc: %d ticks\n", grow(rounds));
+  printf("mallocbench: heap grew %d KB for large blocks, %d KB in all\n",
+         (int)(top1 - top0) / 1024, (int)(sbrk(0) - top0) / 1024);
+  exit(0);
+}
@@ -1,19 +1,47 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/usyscall.h"
 #include "user/user.h"
 
 #include <stdarg.h>
 
 static char digits[] = "0123456789ABCDEF";
 
+// the output of one printf() call, collected in buf and
+// passed on a bufferful at a time: to the stream f, or,
+// for a descriptor with no stream, straight to write().
+struct out {
+  FILE *f;
+  int fd;
+  int n;
+  char buf[128];
+};
+
+static void
+flushout(struct out *o)
+{
+  if(o->n == 0)
+    return;
+  if(o->f)
+    fwrite(o->buf, 1, o->n, o->f);
+  else
+    write(o->fd, o->buf, o->n);
+  o->n = 0;
+}
+
 static void
-putc(int fd, char c)
+putc(struct out *o, char c)
 {
-  write(fd, &c, 1);
+  if(o->n == sizeof(o->buf))
+    flushout(o);
+  o->buf[o->n++] = c;
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(struct out *o, int xx, int base, int sgn)
 {
   char buf[16];
   int i, neg;
@@ -35,21 +63,21 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(struct out *o, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-vprintf(int fd, const char *fmt, va_list ap)
+// Format to o. Only understands %d, %l, %x, %p, %s, %c.
+static void
+vformat(struct out *o, const char *fmt, va_list ap)
 {
   char *s;
   int c, i, state;
@@ -61,53 +89,88 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(o, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(o, va_arg(ap, int), 10, 1);
       } else if(c == 'l') {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(o, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(o, va_arg(ap, int), 16, 0);
       } else if(c == 'p') {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(o, va_arg(ap, uint64));
       } else if(c == 's'){
         s = va_arg(ap, char*);
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(o, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, va_arg(ap, uint));
+        putc(o, va_arg(ap, uint));
       } else if(c == '%'){
-        putc(fd, c);
+        putc(o, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(o, '%');
+        putc(o, c);
       }
       state = 0;
     }
   }
 }
 
+// fd 1 and 2 go through stdout and stderr, so that
+// output to them stays in order. But the streams have no
+// locks, so once clone() has made threads (and flushed
+// the streams) each call goes straight to write().
+static void
+startout(struct out *o, int fd)
+{
+  struct usyscall *u = (struct usyscall*)USYSCALL;
+
+  o->fd = fd;
+  o->n = 0;
+  o->f = 0;
+  if(!u->threaded)
+    o->f = fd == 1 ? stdout : fd == 2 ? stderr : 0;
+}
+
 void
 fprintf(int fd, const char *fmt, ...)
 {
+  struct out o;
   va_list ap;
 
+  startout(&o, fd);
   va_start(ap, fmt);
-  vprintf(fd, fmt, ap);
+  vformat(&o, fmt, ap);
+  flushout(&o);
 }
 
 void
 printf(const char *fmt, ...)
 {
+  struct out o;
+  va_list ap;
+
+  startout(&o, 1);
+  va_start(ap, fmt);
+  vformat(&o, fmt, ap);
+  flushout(&o);
+}
+
+void
+ffprintf(FILE *f, const char *fmt, ...)
+{
+  struct out o;
   va_list ap;
 
+  o.f = f;
+  o.n = 0;
   va_start(ap, fmt);
-  vprintf(1, fmt, ap);
+  vformat(&o, fmt, ap);
+  flushout(&o);
 }
@@ -0,0 +1,307 @@
+// Run a command with the kernel's sampling profiler on, and
+// print a flat profile of where the time went, both in the
+// kernel and in the command's own code.
+//
+// usage: prof [-c] [-i usecs] command [arg ...]
+//   -c  split kernel lines by the interrupted function's caller
+//
+// A second thread drains samples from the kernel while the
+// command runs. Kernel addresses are named from /kernel.sym,
+// and the command's from /<command>.sym; make puts the symbol
+// tables in the file system.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define MAXSAMPLE 16384
+#define NSLOT     1024    // distinct places in the profile
+
+struct profsample samples[MAXSAMPLE];
+struct profsample scratch[256];
+int nsample;
+int cflag;
+int lost;                 // read after samples[] filled up
+volatile int done;
+char drainstack[4096];
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+struct symtab {
+  struct sym *syms;       // sorted by address
+  int n;
+};
+
+// one line of the profile.
+struct slot {
+  char *name;
+  char *caller;           // with -c, for kernel lines
+  int user;
+  int count;
+} slots[NSLOT];
+int nslot;
+
+// move what the kernel has collected into samples[].
+void
+drain(void)
+{
+  int n;
+
+  while(nsample < MAXSAMPLE &&
+        (n = prof(PROF_READ, (uint64)&samples[nsample], MAXSAMPLE - nsample)) > 0)
+    nsample += n;
+  if(nsample == MAXSAMPLE)
+    while((n = prof(PROF_READ, (uint64)scratch, sizeof(scratch)/sizeof(scratch[0]))) > 0)
+      lost += n;
+}
+
+void
+drainer(void *arg)
+{
+  while(!done){
+    drain();
+    nanosleep(20*1000*1000);
+  }
+}
+
+uint64
+hex(char *s, char **end)
+{
+  uint64 x = 0;
+  int d;
+
+  for(; ; s++){
+    if(*s >= '0' && *s <= '9')
+      d = *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      d = *s - 'a' + 10;
+    else
+      break;
+    x = x * 16 + d;
+  }
+  *end = s;
+  return x;
+}
+
+// is name a function or object, rather than a file,
+// section or local label?
+int
+realsym(char *name, int len)
+{
+  if(len == 0 || name[0] == '.' || name[0] == '$')
+    return 0;
+  if(len > 2 && name[len-2] == '.' && (name[len-1] == 'c' || name[len-1] == 'S'))
+    return 0;
+  return 1;
+}
+
+// Read a symbol table as the Makefile writes them, one
+// "address name" line per symbol. Returns -1 if there is none.
+int
+loadsyms(char *path, struct symtab *t)
+{
+  char *buf, *p, *q, *nl;
+  int fd, n, size, cap, i, j, gap;
+  struct sym s;
+
+  t->n = 0;
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  cap = 4096;
+  size = 0;
+  buf = malloc(cap + 1);
+  while(buf && (n = read(fd, buf + size, cap - size)) > 0){
+    size += n;
+    if(size == cap){
+      cap *= 2;
+      buf = realloc(buf, cap + 1);
+    }
+  }
+  close(fd);
+  if(buf == 0)
+    return -1;
+  buf[size] = 0;
+
+  n = 0;
+  for(p = buf; (p = strchr(p, '\n')) != 0; p++)
+    n++;
+  if((t->syms = malloc((n + 1) * sizeof(struct sym))) == 0)
+    return -1;
+  for(p = buf; *p; p = nl + 1){
+    if((nl = strchr(p, '\n')) == 0)
+      break;
+    *nl = 0;
+    s.addr = hex(p, &q);
+    if(*q != ' ' || !realsym(q + 1, nl - q - 1))
+      continue;
+    s.name = q + 1;
+    t->syms[t->n++] = s;
+  }
+
+  // shell sort by address.
+  for(gap = t->n / 2; gap > 0; gap /= 2){
+    for(i = gap; i < t->n; i++){
+      s = t->syms[i];
+      for(j = i; j >= gap && t->syms[j-gap].addr > s.addr; j -= gap)
+        t->syms[j] = t->syms[j-gap];
+      t->syms[j] = s;
+    }
+  }
+  return 0;
+}
+
+// the name of the symbol that contains pc, or 0.
+char*
+lookup(struct symtab *t, uint64 pc)
+{
+  int lo, hi, mid;
+
+  if(t->n == 0 || pc < t->syms[0].addr)
+    return 0;
+  lo = 0;
+  hi = t->n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(t->syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return t->syms[lo].name;
+}
+
+void
+count(char *name, char *caller, int user)
+{
+  int i;
+
+  for(i = 0; i < nslot; i++){
+    if(slots[i].name == name && slots[i].caller == caller &&
+       slots[i].user == user){
+      slots[i].count++;
+      return;
+    }
+  }
+  if(nslot == NSLOT){
+    lost++;
+    return;
+  }
+  slots[nslot].name = name;
+  slots[nslot].caller = caller;
+  slots[nslot].user = user;
+  slots[nslot].count = 1;
+  nslot++;
+}
+
+void
+report(int pid, char *prog)
+{
+  static struct symtab ksyms, usyms;
+  char path[MAXPATH], *name, *caller, *base;
+  struct profsample *s;
+  struct slot t;
+  int i, j;
+
+  for(base = prog; *prog; prog++)
+    if(*prog == '/')
+      base = prog + 1;
+  if(strlen(base) + 6 > sizeof(path))
+    base = "";
+  path[0] = '/';
+  strcpy(path + 1, base);
+  strcpy(path + 1 + strlen(base), ".sym");
+  if(loadsyms("/kernel.sym", &ksyms) < 0)
+    fprintf(2, "prof: no /kernel.sym\n");
+  if(loadsyms(path, &usyms) < 0)
+    fprintf(2, "prof: no %s\n", path);
+
+  for(i = 0; i < nsample; i++){
+    s = &samples[i];
+    caller = 0;
+    if(cflag && !s->user && s->caller)
+      caller = lookup(&ksyms, s->caller);
+    if(!s->user)
+      name = lookup(&ksyms, s->pc);
+    else if(s->pid == pid)
+      name = lookup(&usyms, s->pc);
+    else
+      name = "(other programs)";
+    count(name ? name : "(unknown)", caller, s->user);
+  }
+
+  // most samples first.
+  for(i = 1; i < nslot; i++){
+    t = slots[i];
+    for(j = i; j > 0 && slots[j-1].count < t.count; j--)
+      slots[j] = slots[j-1];
+    slots[j] = t;
+  }
+
+  printf("prof: %d samples, %d lost\n", nsample, lost);
+  printf("  count   %%\n");
+  for(i = 0; i < nslot; i++){
+    printf("%d %d%% %s %s", slots[i].count,
+           slots[i].count * 100 / nsample,
+           slots[i].user ? "user" : "kernel", slots[i].name);
+    if(slots[i].caller)
+      printf(" <- %s", slots[i].caller);
+    printf("\n");
+  }
+}
+
+void
+usage(void)
+{
+  fprintf(2, "usage: prof [-c] [-i usecs] command [arg ...]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fds[3] = { 0, 1, 2 };
+  int pid, tid, i;
+  uint64 tick;
+
+  tick = 0;
+  for(i = 1; i < argc && argv[i][0] == '-'; i++){
+    if(strcmp(argv[i], "-c") == 0)
+      cflag = 1;
+    else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc && atoi(argv[i+1]) > 0)
+      tick = (uint64)atoi(argv[++i]) * (TIMEBASE / 1000000);
+    else
+      usage();
+  }
+  if(i >= argc)
+    usage();
+
+  if(prof(PROF_START, tick, 0) < 0){
+    fprintf(2, "prof: cannot start the profiler\n");
+    exit(1);
+  }
+  tid = thread_create(drainer, 0, drainstack, sizeof(drainstack));
+  if(tid < 0){
+    fprintf(2, "prof: thread_create failed\n");
+    exit(1);
+  }
+  if((pid = spawn(argv[i], argv + i, fds, 3)) < 0)
+    fprintf(2, "prof: cannot run %s\n", argv[i]);
+  else
+    while(wait(0) != pid)
+      ;
+  done = 1;
+  join(tid, 0);
+  lost += prof(PROF_STOP, 0, 0);
+  drain();
+
+  if(pid < 0 || nsample == 0)
+    exit(1);
+  report(pid, argv[i]);
+  exit(0);
+}
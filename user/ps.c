@@ -0,0 +1,124 @@
+// List processes, with the CPU time and system calls each
+// has used, and the most of its kernel stack (in bytes)
+// seen in use. With -t, act like a one-shot top: sample twice,
+// secs seconds apart, and list the processes that ran in
+// between, busiest first.
+//
+// usage: ps [-t [secs]]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+#define MS(t) ((int)((t) / (TIMEBASE / 1000)))
+
+// fetch a listing of every process into *psp,
+// growing the array as needed. returns the count.
+int
+getprocs(struct procstat **psp, int *cap)
+{
+  int n;
+
+  for(;;){
+    if(*psp == 0){
+      *cap = *cap ? *cap * 2 : 64;
+      if((*psp = malloc(*cap * sizeof(**psp))) == 0){
+        fprintf(2, "ps: out of memory\n");
+        exit(1);
+      }
+    }
+    if((n = procstat(*psp, *cap)) < 0){
+      fprintf(2, "ps: procstat failed\n");
+      exit(1);
+    }
+    if(n < *cap)
+      return n;
+    free(*psp);
+    *psp = 0;
+  }
+}
+
+void
+list(void)
+{
+  struct procstat *ps = 0;
+  int i, n, cap = 0;
+
+  n = getprocs(&ps, &cap);
+  printf("PID\tPPID\tSTATE\tCPU\tKB\tUSER\tSYS\tCALLS\tKSTACK\tNAME\n");
+  for(i = 0; i < n; i++){
+    printf("%d\t%d\t%s\t%d\t%d\t%dms\t%dms\t%d\t%d\t%s\n",
+           ps[i].pid, ps[i].ppid, ps[i].state, ps[i].cpu,
+           (int)(ps[i].sz / 1024), MS(ps[i].ru.utime), MS(ps[i].ru.stime),
+           (int)ps[i].ru.nsyscall, (int)ps[i].maxstack, ps[i].name);
+  }
+}
+
+// CPU time p used since the matching entry in old, if any.
+uint64
+delta(struct procstat *p, struct procstat *old, int nold)
+{
+  int i;
+
+  for(i = 0; i < nold; i++)
+    if(old[i].pid == p->pid)
+      return p->ru.utime + p->ru.stime - old[i].ru.utime - old[i].ru.stime;
+  return p->ru.utime + p->ru.stime;
+}
+
+void
+top(int secs)
+{
+  struct procstat *old = 0, *cur = 0, t;
+  uint64 *d, dt;
+  int i, j, nold, ncur, capold = 0, capcur = 0;
+
+  nold = getprocs(&old, &capold);
+  nanosleep((uint64)secs * 1000000000);
+  ncur = getprocs(&cur, &capcur);
+
+  if((d = malloc(ncur * sizeof(*d) + 1)) == 0){
+    fprintf(2, "ps: out of memory\n");
+    exit(1);
+  }
+  for(i = 0; i < ncur; i++)
+    d[i] = delta(&cur[i], old, nold);
+
+  // insertion sort, busiest first.
+  for(i = 1; i < ncur; i++){
+    for(j = i; j > 0 && d[j-1] < d[j]; j--){
+      dt = d[j]; d[j] = d[j-1]; d[j-1] = dt;
+      t = cur[j]; cur[j] = cur[j-1]; cur[j-1] = t;
+    }
+  }
+
+  printf("PID\tCPU%%\tSTATE\tCPU\tVCSW\tIVCSW\tNAME\n");
+  for(i = 0; i < ncur && d[i] > 0; i++){
+    printf("%d\t%d\t%s\t%d\t%d\t%d\t%s\n",
+           cur[i].pid, (int)(d[i] * 100 / ((uint64)secs * TIMEBASE)),
+           cur[i].state, cur[i].cpu, (int)cur[i].ru.nvcsw,
+           (int)cur[i].ru.nivcsw, cur[i].name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int secs;
+
+  if(argc == 1){
+    list();
+    exit(0);
+  }
+  if(strcmp(argv[1], "-t") == 0 && argc <= 3){
+    secs = argc == 3 ? atoi(argv[2]) : 1;
+    if(secs > 0){
+      top(secs);
+      exit(0);
+    }
+  }
+  fprintf(2, "usage: ps [-t [secs]]\n");
+  exit(1);
+}
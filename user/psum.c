@@ -0,0 +1,114 @@
+// Sum an array in parallel with 1, 2, ... threads made by
+// clone(), all sharing the array, to see how the work
+// scales across CPUs.
+//
+// usage: psum [maxthreads [kints]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXT 8
+#define ROUNDS 32
+#define STACKSZ 4096
+
+int *a;
+
+// one per thread, a cache line each so that the
+// threads' sums do not share lines.
+struct work {
+  int lo, hi;
+  uint64 sum;
+  char pad[48];
+} work[MAXT];
+
+char *stacks[MAXT];
+
+void
+sumpart(void *arg)
+{
+  struct work *w = arg;
+  uint64 s = 0;
+  int r, i;
+
+  for(r = 0; r < ROUNDS; r++)
+    for(i = w->lo; i < w->hi; i++)
+      s += a[i];
+  w->sum = s;
+}
+
+// sum a[0..n) with nt threads; returns elapsed ticks.
+int
+psum(int nt, int n, uint64 want)
+{
+  int i, tids[MAXT], t0, t;
+  uint64 sum;
+
+  t0 = uptime();
+  for(i = 0; i < nt; i++){
+    work[i].lo = (uint64)n * i / nt;
+    work[i].hi = (uint64)n * (i+1) / nt;
+    work[i].sum = 0;
+    if((tids[i] = thread_create(sumpart, &work[i], stacks[i], STACKSZ)) < 0){
+      fprintf(2, "psum: thread_create failed\n");
+      exit(1);
+    }
+  }
+  sum = 0;
+  for(i = 0; i < nt; i++){
+    if(join(tids[i], 0) != tids[i]){
+      fprintf(2, "psum: join failed\n");
+      exit(1);
+    }
+    sum += work[i].sum;
+  }
+  t = uptime() - t0;
+  if(sum != want){
+    fprintf(2, "psum: wrong sum with %d threads\n", nt);
+    exit(1);
+  }
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, maxt, t, t1;
+  uint64 want;
+
+  maxt = argc > 1 ? atoi(argv[1]) : 4;
+  n = (argc > 2 ? atoi(argv[2]) : 1024) * 1024;
+  if(maxt < 1 || maxt > MAXT || n <= 0){
+    fprintf(2, "usage: psum [maxthreads (1-%d) [kints]]\n", MAXT);
+    exit(1);
+  }
+
+  // malloc() is not thread-safe; get everything now.
+  if((a = malloc(n * sizeof(int))) == 0){
+    fprintf(2, "psum: out of memory\n");
+    exit(1);
+  }
+  for(i = 0; i < maxt; i++)
+    if((stacks[i] = malloc(STACKSZ)) == 0){
+      fprintf(2, "psum: out of memory\n");
+      exit(1);
+    }
+  want = 0;
+  for(i = 0; i < n; i++){
+    a[i] = i & 0xff;
+    want += a[i];
+  }
+  want *= ROUNDS;
+
+  t1 = 0;
+  for(i = 1; i <= maxt; i++){
+    t = psum(i, n, want);
+    if(i == 1)
+      t1 = t;
+    printf("psum: %d threads: %d ticks", i, t);
+    if(t > 0)
+      printf(", speedup %d.%d", t1 / t, (t1 * 10 / t) % 10);
+    printf("\n");
+  }
+  exit(0);
+}
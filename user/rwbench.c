@@ -0,0 +1,241 @@
+// Measure read()/write() throughput as a function of the
+// size of each call, through a pipe and from a cached file.
+// With -c, instead measure writing a log to the console.
+// With -s, count the system calls it takes to print and
+// read back formatted lines, with and without stdio.
+//
+// usage: rwbench [-c|-s] [kbytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+#define MAXSZ 32768
+#define FILESZ (8*1024)   // small enough to stay in the buffer cache
+
+char buf[MAXSZ];
+int sizes[] = { 1, 16, 64, 512, 4096, MAXSZ };
+#define NSIZES (sizeof(sizes)/sizeof(sizes[0]))
+
+// send total bytes from a child to the parent through a pipe,
+// sz bytes per read() and write(). returns elapsed ticks.
+int
+pipebench(int sz, int total)
+{
+  int fds[2], n, got, t0, t1;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "rwbench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  int pid = fork();
+  if(pid < 0){
+    fprintf(2, "rwbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < total; n += sz){
+      if(write(fds[1], buf, sz) != sz){
+        fprintf(2, "rwbench: pipe write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], buf, sz)) > 0)
+    got += n;
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+  if(got < total){
+    fprintf(2, "rwbench: short pipe read %d\n", got);
+    exit(1);
+  }
+  return t1 - t0;
+}
+
+// read total bytes out of a small file, sz bytes per read().
+// returns elapsed ticks.
+int
+filebench(int sz, int total)
+{
+  int fd, n, got, t0;
+
+  t0 = uptime();
+  for(got = 0; got < total; ){
+    if((fd = open("rwbench.tmp", O_RDONLY)) < 0){
+      fprintf(2, "rwbench: open failed\n");
+      exit(1);
+    }
+    while(got < total && (n = read(fd, buf, sz)) > 0)
+      got += n;
+    close(fd);
+  }
+  return uptime() - t0;
+}
+
+// write total bytes of log lines to the console,
+// sz bytes per write(). returns elapsed ticks.
+int
+consbench(int sz, int total)
+{
+  int i, n, t0;
+
+  for(i = 0; i < sz; i++)
+    buf[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+  t0 = uptime();
+  for(n = 0; n < total; n += sz){
+    if(write(1, buf, sz) != sz){
+      fprintf(2, "rwbench: console write failed\n");
+      exit(1);
+    }
+  }
+  return uptime() - t0;
+}
+
+// system calls made so far.
+int
+nsyscall(void)
+{
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.nsyscall;
+}
+
+// print total bytes of numbered lines to rwbench.tmp, as
+// the old printf() did, a write() per byte; with fprintf()
+// to a descriptor, a write() per call; and with stdio.
+// then read them back a byte at a time, and with stdio.
+// reports system calls per MB.
+void
+stdiobench(int total)
+{
+  int i, n, fd, s0, mb;
+  char line[64];
+  FILE *f;
+
+  mb = total / (1024*1024);
+  if(mb == 0)
+    mb = 1;
+  for(i = 0; i < 3; i++){
+    if((fd = open("rwbench.tmp", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      fprintf(2, "rwbench: cannot create rwbench.tmp\n");
+      exit(1);
+    }
+    f = i == 2 ? fdopen(fd, "w") : 0;
+    s0 = nsyscall();
+    for(n = 0; n < total; n += 32){
+      if(i == 0){
+        int k;
+        for(k = 0; k < 32; k++)
+          write(fd, k == 31 ? "\n" : "x", 1);
+      } else if(i == 1){
+        fprintf(fd, "line %d of the log, padded....\n", n / 32 % 1000);
+      } else {
+        ffprintf(f, "line %d of the log, padded....\n", n / 32 % 1000);
+      }
+    }
+    if(f)
+      fclose(f);
+    else
+      close(fd);
+    printf("rwbench: print %s: %d syscalls/MB\n",
+           i == 0 ? "write per byte" : i == 1 ? "fprintf(fd)" : "stdio",
+           (nsyscall() - s0) / mb);
+  }
+
+  for(i = 0; i < 2; i++){
+    s0 = nsyscall();
+    if(i == 0){
+      if((fd = open("rwbench.tmp", O_RDONLY)) < 0)
+        exit(1);
+      while(read(fd, line, 1) == 1)
+        ;
+      close(fd);
+    } else {
+      if((f = fopen("rwbench.tmp", "r")) == 0)
+        exit(1);
+      while(fgets(line, sizeof(line), f) != 0)
+        ;
+      fclose(f);
+    }
+    printf("rwbench: read %s: %d syscalls/MB\n",
+           i == 0 ? "byte at a time" : "stdio", (nsyscall() - s0) / mb);
+  }
+  unlink("rwbench.tmp");
+}
+
+void
+report(char *what, int sz, int kb, int t)
+{
+  printf("rwbench: %s size %d: %d KB in %d ticks", what, sz, kb, t);
+  if(t > 0)
+    printf(", %d KB/tick", kb / t);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, kb, cons, sys;
+
+  cons = sys = 0;
+  if(argc > 1 && strcmp(argv[1], "-c") == 0){
+    cons = 1;
+    argc--;
+    argv++;
+  } else if(argc > 1 && strcmp(argv[1], "-s") == 0){
+    sys = 1;
+    argc--;
+    argv++;
+  }
+  kb = cons ? 64 : 1024;
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb <= 0){
+    fprintf(2, "usage: rwbench [-c|-s] [kbytes]\n");
+    exit(1);
+  }
+
+  if(sys){
+    stdiobench(kb * 1024);
+    exit(0);
+  }
+
+  if(cons){
+    int t = consbench(4096, kb * 1024);
+    // the log went to fd 1; put the result on fd 2.
+    fprintf(2, "rwbench: console: %d KB in %d ticks", kb, t);
+    if(t > 0)
+      fprintf(2, ", %d bytes/tick", kb * 1024 / t);
+    fprintf(2, "\n");
+    exit(0);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+
+  if((fd = open("rwbench.tmp", O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+     write(fd, buf, FILESZ) != FILESZ){
+    fprintf(2, "rwbench: cannot create rwbench.tmp\n");
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < NSIZES; i++){
+    // one-byte calls are slow; move less data for them.
+    int k = sizes[i] < 64 ? kb / 16 : kb;
+    if(k == 0)
+      k = 1;
+    report("pipe", sizes[i], k, pipebench(sizes[i], k * 1024));
+    report("file", sizes[i], k, filebench(sizes[i], k * 1024));
+  }
+  unlink("rwbench.tmp");
+  exit(0);
+}
@@ -1,6 +1,16 @@
 // Shell.
+//
+// The shell starts every program in a command line itself:
+// each stage of a pipeline is a child of the shell, made with
+// spawn() when it is a plain program and by forking a copy of
+// the shell otherwise. echo, cd and exit are built in, and a
+// line that begins with time reports how long it took.
 
 #include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/rusage.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
 
@@ -52,18 +62,91 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 void runcmd(struct cmd*) __attribute__((noreturn));
+int startcmd(struct cmd*, int*);
+int builtin(char**, int*);
+int isbuiltin(struct cmd*);
+
+int stdfds[3] = { 0, 1, 2 };
+
+// Programs the shell has found. A name without a '/' is the
+// file of that name in the current directory, or else in /.
+// Finding out costs a stat() per place tried, so the answers
+// are remembered until the next cd.
+#define NPROG 16
+
+struct prog {
+  char name[DIRSIZ+1];    // empty if the slot is unused
+  char path[DIRSIZ+2];    // name or /name
+} progs[NPROG];
+int nextprog;             // slot to reuse next
+
+// the path to run for the program name.
+char*
+findprog(char *name)
+{
+  struct prog *pp;
+  struct stat st;
+
+  if(strchr(name, '/') || strlen(name) > DIRSIZ)
+    return name;
+  for(pp = progs; pp < &progs[NPROG]; pp++)
+    if(pp->name[0] && strcmp(pp->name, name) == 0)
+      return pp->path;
+
+  pp = &progs[nextprog];
+  nextprog = (nextprog + 1) % NPROG;
+  strcpy(pp->path, name);
+  if(stat(pp->path, &st) < 0 || st.type != T_FILE){
+    pp->path[0] = '/';
+    strcpy(pp->path + 1, name);
+    if(stat(pp->path, &st) < 0 || st.type != T_FILE){
+      pp->name[0] = 0;
+      return name;
+    }
+  }
+  strcpy(pp->name, name);
+  return pp->path;
+}
+
+// forget what findprog() said about name.
+// returns 1 if it had said anything.
+int
+forgetprog(char *name)
+{
+  struct prog *pp;
+
+  for(pp = progs; pp < &progs[NPROG]; pp++){
+    if(pp->name[0] && strcmp(pp->name, name) == 0){
+      pp->name[0] = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Spawn the program argv[0] with fds as its 0, 1 and 2.
+// If a remembered path no longer works, look again.
+int
+spawnprog(char **argv, int *fds)
+{
+  int pid;
+
+  if((pid = spawn(findprog(argv[0]), argv, fds, 3)) < 0 && forgetprog(argv[0]))
+    pid = spawn(findprog(argv[0]), argv, fds, 3);
+  return pid;
+}
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
-  int p[2];
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
-  struct pipecmd *pcmd;
   struct redircmd *rcmd;
+  int n;
 
   if(cmd == 0)
     exit(1);
@@ -76,7 +159,9 @@ runcmd(struct cmd *cmd)
     ecmd = (struct execcmd*)cmd;
     if(ecmd->argv[0] == 0)
       exit(1);
-    exec(ecmd->argv[0], ecmd->argv);
+    if(builtin(ecmd->argv, stdfds))
+      break;
+    exec(findprog(ecmd->argv[0]), ecmd->argv);
     fprintf(2, "exec %s failed\n", ecmd->argv[0]);
     break;
 
@@ -99,27 +184,8 @@ runcmd(struct cmd *cmd)
     break;
 
   case PIPE:
-    pcmd = (struct pipecmd*)cmd;
-    if(pipe(p) < 0)
-      panic("pipe");
-    if(fork1() == 0){
-      close(1);
-      dup(p[1]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->left);
-    }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
-    }
-    close(p[0]);
-    close(p[1]);
-    wait(0);
-    wait(0);
+    for(n = startcmd(cmd, stdfds); n > 0; n--)
+      wait(0);
     break;
 
   case BACK:
@@ -131,6 +197,217 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Run cmd in a copy of the shell, with the shell's
+// descriptors fds[0..2] as its 0, 1 and 2.
+int
+forkcmd(struct cmd *cmd, int *fds)
+{
+  int i;
+
+  if(fork1() == 0){
+    for(i = 0; i < 3; i++){
+      if(fds[i] != i){
+        close(i);
+        dup(fds[i]);
+      }
+    }
+    // other stages' pipe ends would keep readers from
+    // ever seeing end of file.
+    for(i = 3; i < NOFILE; i++)
+      close(i);
+    runcmd(cmd);
+  }
+  return 1;
+}
+
+// Start one stage of a pipeline. A builtin there runs in
+// a copy of the shell, so that "exit | cat" or "cd d | cat"
+// leaves the shell itself alone.
+int
+startstage(struct cmd *cmd, int *fds)
+{
+  if(isbuiltin(cmd))
+    return forkcmd(cmd, fds);
+  return startcmd(cmd, fds);
+}
+
+// Start cmd, giving each program in it the shell's
+// descriptors fds[0..2] as its 0, 1 and 2. Every stage of
+// a pipeline is started here, as a child of the caller.
+// Returns the number of processes started.
+int
+startcmd(struct cmd *cmd, int *fds)
+{
+  int p[2], fd, n, nfds[3];
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0 || builtin(ecmd->argv, fds))
+      return 0;
+    if(spawnprog(ecmd->argv, fds) < 0){
+      fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if(rcmd->fd > 2)
+      break;
+    if((fd = open(rcmd->file, rcmd->mode)) < 0){
+      fprintf(2, "open %s failed\n", rcmd->file);
+      return 0;
+    }
+    memmove(nfds, fds, sizeof(nfds));
+    nfds[rcmd->fd] = fd;
+    n = startcmd(rcmd->cmd, nfds);
+    close(fd);
+    return n;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0){
+      fprintf(2, "pipe failed\n");
+      return 0;
+    }
+    memmove(nfds, fds, sizeof(nfds));
+    nfds[1] = p[1];
+    n = startstage(pcmd->left, nfds);
+    nfds[0] = p[0];
+    nfds[1] = fds[1];
+    n += startstage(pcmd->right, nfds);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+  return forkcmd(cmd, fds);
+}
+
+// Run a command line: the parts of a list one after
+// another, each from the shell itself.
+void
+runline(struct cmd *cmd)
+{
+  struct listcmd *lcmd;
+  int n;
+
+  if(cmd->type == LIST){
+    lcmd = (struct listcmd*)cmd;
+    runline(lcmd->left);
+    runline(lcmd->right);
+    return;
+  }
+  for(n = startcmd(cmd, stdfds); n > 0; n--)
+    wait(0);
+}
+
+// time: run a command line and report the ticks it took,
+// and the CPU time its programs used.
+void
+timeline(struct cmd *cmd)
+{
+  struct rusage r0, r1;
+  int t0;
+
+  t0 = uptime();
+  getrusage(RUSAGE_CHILDREN, &r0);
+  runline(cmd);
+  getrusage(RUSAGE_CHILDREN, &r1);
+  fprintf(2, "%d ticks, user %dms, sys %dms\n", uptime() - t0,
+          (int)((r1.utime - r0.utime) / (TIMEBASE/1000)),
+          (int)((r1.stime - r0.stime) / (TIMEBASE/1000)));
+}
+
+//PAGEBREAK!
+// Builtins. Each runs in the shell itself, with the
+// descriptors the program would have had as 0, 1 and 2.
+
+void
+doecho(char **argv, int *fds)
+{
+  char line[128];   // argv came from a line shorter than this
+  int i, n, k;
+
+  n = 0;
+  for(i = 1; argv[i]; i++){
+    k = strlen(argv[i]);
+    if(n + k + 2 > sizeof(line))
+      break;
+    if(i > 1)
+      line[n++] = ' ';
+    memmove(line + n, argv[i], k);
+    n += k;
+  }
+  line[n++] = '\n';
+  write(fds[1], line, n);
+}
+
+void
+docd(char **argv, int *fds)
+{
+  char *dir = argv[1] ? argv[1] : "/";
+
+  if(chdir(dir) < 0){
+    fprintf(fds[2], "cannot cd %s\n", dir);
+    return;
+  }
+  memset(progs, 0, sizeof(progs));
+}
+
+void
+doexit(char **argv, int *fds)
+{
+  exit(argv[1] ? atoi(argv[1]) : 0);
+}
+
+struct {
+  char *name;
+  void (*f)(char**, int*);
+} builtins[] = {
+  { "cd", docd },
+  { "echo", doecho },
+  { "exit", doexit },
+};
+
+// if argv[0] is a builtin, run it and return 1.
+int
+builtin(char **argv, int *fds)
+{
+  int i;
+
+  for(i = 0; i < sizeof(builtins)/sizeof(builtins[0]); i++){
+    if(strcmp(argv[0], builtins[i].name) == 0){
+      builtins[i].f(argv, fds);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// is cmd a builtin, perhaps with redirections?
+int
+isbuiltin(struct cmd *cmd)
+{
+  struct execcmd *ecmd;
+  int i;
+
+  while(cmd->type == REDIR)
+    cmd = ((struct redircmd*)cmd)->cmd;
+  if(cmd->type != EXEC)
+    return 0;
+  ecmd = (struct execcmd*)cmd;
+  if(ecmd->argv[0] == 0)
+    return 0;
+  for(i = 0; i < sizeof(builtins)/sizeof(builtins[0]); i++)
+    if(strcmp(ecmd->argv[0], builtins[i].name) == 0)
+      return 1;
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -146,7 +423,9 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  struct cmd *cmd;
+  char *s;
+  int fd, timed;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -158,16 +437,17 @@ main(void)
 
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
-    if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
-      // Chdir must be called by the parent, not the child.
-      buf[strlen(buf)-1] = 0;  // chop \n
-      if(chdir(buf+3) < 0)
-        fprintf(2, "cannot cd %s\n", buf+3);
+    s = buf;
+    timed = memcmp(s, "time", 4) == 0 && strchr(" \t\r\n", s[4]);
+    if(timed)
+      s += 4;
+    if((cmd = parsecmd(s)) == 0)
       continue;
-    }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    if(timed)
+      timeline(cmd);
+    else
+      runline(cmd);
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -325,18 +605,36 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// the shell parses commands itself, so a syntax error
+// must not exit; note it, and let parsecmd() fail.
+int parseerr;
+
+void
+syntax(char *msg)
+{
+  if(!parseerr)
+    fprintf(2, "%s\n", msg);
+  parseerr = 1;
+}
+
+// Parse s, or return 0 after reporting a syntax error.
 struct cmd*
 parsecmd(char *s)
 {
   char *es;
   struct cmd *cmd;
 
+  parseerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -380,8 +678,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -406,8 +706,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -432,13 +734,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -446,6 +752,44 @@ parseexec(char **ps, char *es)
   return ret;
 }
 
+// Free a command tree made by parsecmd().
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
+
 // NUL-terminate all the counted strings.
 struct cmd*
 nulterminate(struct cmd *cmd)
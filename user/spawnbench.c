@@ -0,0 +1,120 @@
+// Measure how many commands per second can be started:
+// with fork() and exec(), with spawn(), and by sh reading
+// a script of simple commands, which sh runs with spawn().
+// The script names /echo, since plain echo is built into sh.
+//
+// usage: spawnbench [n]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char *echoargv[] = { "echo", "hi", 0 };
+char buf[512];
+
+// run echo n times, with its output going to a pipe
+// that is drained after each one. returns elapsed ticks.
+int
+runechos(int n, int usespawn)
+{
+  int i, pid, p[2], fds[3], t0;
+
+  if(pipe(p) < 0){
+    fprintf(2, "spawnbench: pipe failed\n");
+    exit(1);
+  }
+  fds[0] = 0;
+  fds[1] = p[1];
+  fds[2] = 2;
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(usespawn){
+      pid = spawn("echo", echoargv, fds, 3);
+    } else if((pid = fork()) == 0){
+      close(1);
+      dup(p[1]);
+      close(p[0]);
+      close(p[1]);
+      exec("echo", echoargv);
+      exit(1);
+    }
+    if(pid < 0){
+      fprintf(2, "spawnbench: cannot start echo\n");
+      exit(1);
+    }
+    wait(0);
+    read(p[0], buf, sizeof(buf));
+  }
+  close(p[0]);
+  close(p[1]);
+  return uptime() - t0;
+}
+
+// have sh run a script of n echo commands.
+// returns elapsed ticks.
+int
+runscript(int n)
+{
+  char *argv[] = { "sh", 0 };
+  int i, fd, p[2], fds[3], t0;
+
+  if((fd = open("spawnbench.sh", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "spawnbench: cannot create script\n");
+    exit(1);
+  }
+  for(i = 0; i < n; i++)
+    write(fd, "/echo hi\n", 9);
+  close(fd);
+
+  if((fd = open("spawnbench.sh", O_RDONLY)) < 0 || pipe(p) < 0){
+    fprintf(2, "spawnbench: cannot open script\n");
+    exit(1);
+  }
+  // sh's prompts go to the pipe too.
+  fds[0] = fd;
+  fds[1] = p[1];
+  fds[2] = p[1];
+  t0 = uptime();
+  if(spawn("sh", argv, fds, 3) < 0){
+    fprintf(2, "spawnbench: cannot start sh\n");
+    exit(1);
+  }
+  close(fd);
+  close(p[1]);
+  while(read(p[0], buf, sizeof(buf)) > 0)
+    ;
+  close(p[0]);
+  wait(0);
+  i = uptime() - t0;
+  unlink("spawnbench.sh");
+  return i;
+}
+
+void
+report(char *what, int n, int t)
+{
+  printf("spawnbench: %s: %d commands in %d ticks", what, n, t);
+  if(t > 0)
+    printf(", %d per second", n * 10 / t);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = argc > 1 ? atoi(argv[1]) : 200;
+  if(n <= 0){
+    fprintf(2, "usage: spawnbench [n]\n");
+    exit(1);
+  }
+  // make the fork() copy something, as a shell's would.
+  sbrk(256*1024);
+
+  report("fork+exec", n, runechos(n, 0));
+  report("spawn", n, runechos(n, 1));
+  report("sh script", n, runscript(n));
+  exit(0);
+}
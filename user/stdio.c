@@ -0,0 +1,383 @@
+// Buffered streams over file descriptors.
+//
+// A FILE collects output in its buffer and hands it to
+// write() a buffer at a time, or a line at a time for a
+// line-buffered stream; reads are likewise done a buffer at
+// a time. stdout is line-buffered if it is the console and
+// fully buffered otherwise; stderr is unbuffered, though
+// each fprintf() to it is still a single write().
+//
+// fork(), exec(), spawn(), clone() and exit() flush every
+// stream first, so buffered output is neither lost nor
+// written twice. Reading from stdin flushes stdout, so that prompts
+// appear.
+//
+// Like malloc(), not thread-safe: threads made by clone()
+// should not share a stream. printf() and fprintf() to fd
+// 1 and 2 leave the streams alone once there are threads
+// (see printf.c).
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define F_READ   0x1    // opened for reading
+#define F_WRITE  0x2    // opened for writing
+#define F_EOF    0x4    // read() returned 0
+#define F_ERR    0x8    // read() or write() failed
+#define F_MALLOC 0x10   // free the FILE on close
+#define F_MBUF   0x20   // free the buffer on close
+
+static char inbuf[BUFSIZ], outbuf[BUFSIZ], errbuf[128];
+
+static FILE stdfiles[3] = {
+  { 0, _IOFBF, F_READ, inbuf, BUFSIZ, 0, 0, &stdfiles[1] },
+  { 1, -1, F_WRITE, outbuf, BUFSIZ, 0, 0, &stdfiles[2] },  // mode set on first write
+  { 2, _IONBF, F_WRITE, errbuf, sizeof(errbuf), 0, 0, 0 },
+};
+
+FILE *stdin = &stdfiles[0];
+FILE *stdout = &stdfiles[1];
+FILE *stderr = &stdfiles[2];
+
+// every open stream, for fflush(0).
+static FILE *files = &stdfiles[0];
+
+static void
+linkfile(FILE *f)
+{
+  f->next = files;
+  files = f;
+}
+
+// a FILE for fd, which the caller has opened
+// for reading or writing as mode says.
+FILE*
+fdopen(int fd, const char *mode)
+{
+  FILE *f;
+
+  if((f = malloc(sizeof(*f))) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  if((f->buf = malloc(BUFSIZ)) == 0){
+    free(f);
+    return 0;
+  }
+  f->fd = fd;
+  f->mode = -1;
+  f->flags = F_MALLOC | F_MBUF | (mode[0] == 'r' ? F_READ : F_WRITE);
+  f->size = BUFSIZ;
+  linkfile(f);
+  return f;
+}
+
+// open path for reading ("r") or writing ("w"),
+// truncating or creating it.
+FILE*
+fopen(const char *path, const char *mode)
+{
+  FILE *f;
+  int fd;
+
+  if(strcmp(mode, "r") == 0)
+    fd = open(path, O_RDONLY);
+  else if(strcmp(mode, "w") == 0)
+    fd = open(path, O_CREATE|O_TRUNC|O_WRONLY);
+  else
+    return 0;
+  if(fd < 0)
+    return 0;
+  if((f = fdopen(fd, mode)) == 0)
+    close(fd);
+  return f;
+}
+
+// Change f's buffering. If buf is not 0, use its
+// size bytes as the buffer. Call before any I/O on f.
+int
+setvbuf(FILE *f, char *buf, int mode, uint size)
+{
+  if(mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return -1;
+  if(buf){
+    if(size == 0)
+      return -1;
+    if(f->flags & F_MBUF)
+      free(f->buf);
+    f->flags &= ~F_MBUF;
+    f->buf = buf;
+    f->size = size;
+  }
+  f->mode = mode;
+  return 0;
+}
+
+// write out f's buffered output. fflush(0) flushes
+// every stream. returns 0, or EOF on error.
+int
+fflush(FILE *f)
+{
+  int n, r;
+
+  if(f == 0){
+    r = 0;
+    for(f = files; f; f = f->next)
+      if(fflush(f) < 0)
+        r = EOF;
+    return r;
+  }
+  if((f->flags & F_WRITE) == 0)
+    return 0;
+  for(r = 0; r < f->len; r += n){
+    if((n = write(f->fd, f->buf + r, f->len - r)) <= 0){
+      f->flags |= F_ERR;
+      f->len = 0;
+      return EOF;
+    }
+  }
+  f->len = 0;
+  return 0;
+}
+
+int
+fclose(FILE *f)
+{
+  FILE **fp;
+  int r;
+
+  r = fflush(f);
+  if(f->fd > 2 && close(f->fd) < 0)
+    r = EOF;
+  for(fp = &files; *fp; fp = &(*fp)->next){
+    if(*fp == f){
+      *fp = f->next;
+      break;
+    }
+  }
+  if(f->flags & F_MBUF)
+    free(f->buf);
+  if(f->flags & F_MALLOC)
+    free(f);
+  return r;
+}
+
+// choose stdout-style buffering for f on its first write:
+// a line at a time to the console, else a buffer at a time.
+static void
+pickmode(FILE *f)
+{
+  struct stat st;
+
+  if(fstat(f->fd, &st) == 0 && st.type == T_DEVICE)
+    f->mode = _IOLBF;
+  else
+    f->mode = _IOFBF;
+}
+
+int
+fputc(int c, FILE *f)
+{
+  char ch = c;
+
+  if(f->mode == _IOFBF && f->len < f->size){
+    f->buf[f->len++] = c;
+    return c & 0xff;
+  }
+  return fwrite(&ch, 1, 1, f) == 1 ? c & 0xff : EOF;
+}
+
+int
+fputs(const char *s, FILE *f)
+{
+  return fwrite(s, 1, strlen(s), f) == strlen(s) ? 0 : EOF;
+}
+
+// write n items of size bytes each from p.
+// returns the number of items written.
+uint
+fwrite(const void *p, uint size, uint n, FILE *f)
+{
+  const char *s = p;
+  uint total = size * n, i, k;
+  int w;
+
+  if(total == 0)
+    return 0;
+  if(f->mode < 0)
+    pickmode(f);
+  if(f->mode == _IOFBF && f->len + total > f->size){
+    // won't fit: write what is buffered, and if the
+    // rest is at least a buffer's worth, write it directly.
+    if(fflush(f) < 0)
+      return 0;
+    if(total >= f->size){
+      for(i = 0; i < total; i += w)
+        if((w = write(f->fd, s + i, total - i)) <= 0){
+          f->flags |= F_ERR;
+          return i / size;
+        }
+      return n;
+    }
+  }
+  for(i = 0; i < total; i += k){
+    k = f->size - f->len;
+    if(k > total - i)
+      k = total - i;
+    memmove(f->buf + f->len, s + i, k);
+    f->len += k;
+    if(f->len == f->size && fflush(f) < 0)
+      return i / size;
+  }
+  if(f->mode == _IONBF || (f->mode == _IOLBF && memchr(s, '\n', total) != 0))
+    if(fflush(f) < 0)
+      return 0;
+  return n;
+}
+
+// read more into f's buffer. returns 0, or EOF at end
+// of file or on error.
+static int
+refill(FILE *f)
+{
+  int n;
+
+  if((f->flags & F_READ) == 0 || (f->flags & (F_EOF|F_ERR)))
+    return EOF;
+  if(f == stdin)
+    fflush(stdout);
+  n = read(f->fd, f->buf, f->size);
+  if(n <= 0){
+    f->flags |= n == 0 ? F_EOF : F_ERR;
+    return EOF;
+  }
+  f->pos = 0;
+  f->len = n;
+  return 0;
+}
+
+int
+fgetc(FILE *f)
+{
+  if(f->pos == f->len && refill(f) < 0)
+    return EOF;
+  return f->buf[f->pos++] & 0xff;
+}
+
+// read a line of at most max-1 bytes, with its newline,
+// into buf. returns buf, or 0 at end of file.
+char*
+fgets(char *buf, int max, FILE *f)
+{
+  char *nl;
+  int i, k;
+
+  for(i = 0; i + 1 < max; ){
+    if(f->pos == f->len && refill(f) < 0)
+      break;
+    k = f->len - f->pos;
+    if(k > max - 1 - i)
+      k = max - 1 - i;
+    if((nl = memchr(f->buf + f->pos, '\n', k)) != 0)
+      k = nl - (f->buf + f->pos) + 1;
+    memmove(buf + i, f->buf + f->pos, k);
+    f->pos += k;
+    i += k;
+    if(nl)
+      break;
+  }
+  buf[i] = '\0';
+  return i > 0 ? buf : 0;
+}
+
+// read n items of size bytes each into p.
+// returns the number of whole items read.
+uint
+fread(void *p, uint size, uint n, FILE *f)
+{
+  char *d = p;
+  uint total = size * n, i, k;
+  int r;
+
+  for(i = 0; i < total; i += k){
+    if(f->pos == f->len){
+      if(total - i >= f->size && (f->flags & F_READ) &&
+         (f->flags & (F_EOF|F_ERR)) == 0){
+        // big read: skip the buffer.
+        if(f == stdin)
+          fflush(stdout);
+        if((r = read(f->fd, d + i, total - i)) <= 0){
+          f->flags |= r == 0 ? F_EOF : F_ERR;
+          break;
+        }
+        k = r;
+        continue;
+      }
+      if(refill(f) < 0)
+        break;
+    }
+    k = f->len - f->pos;
+    if(k > total - i)
+      k = total - i;
+    memmove(d + i, f->buf + f->pos, k);
+    f->pos += k;
+  }
+  return size ? i / size : 0;
+}
+
+int
+feof(FILE *f)
+{
+  return (f->flags & F_EOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+  return (f->flags & F_ERR) != 0;
+}
+
+int
+fileno(FILE *f)
+{
+  return f->fd;
+}
+
+// The system calls that start or end a program image,
+// wrapped to flush output first.
+
+int
+fork(void)
+{
+  fflush(0);
+  return _fork();
+}
+
+int
+exec(const char *path, char **argv)
+{
+  fflush(0);
+  return _exec(path, argv);
+}
+
+int
+spawn(char *path, char **argv, int *fdmap, int nfd)
+{
+  fflush(0);
+  return _spawn(path, argv, fdmap, nfd);
+}
+
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+  fflush(0);
+  return _clone(fn, arg, stack);
+}
+
+int
+exit(int status)
+{
+  fflush(0);
+  _exit(status);
+}
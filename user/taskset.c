@@ -0,0 +1,72 @@
+// Run a command, or move a running process, on a set of CPUs.
+//
+// usage: taskset mask command [args...]
+//        taskset -p mask pid
+//
+// mask is a bitmask of CPUs, in hex with a 0x prefix or
+// in decimal: taskset 0x3 psum runs psum on CPUs 0 and 1.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+uint64
+parsemask(char *s)
+{
+  uint64 m = 0;
+  int base = 10, d;
+
+  if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X')){
+    base = 16;
+    s += 2;
+  }
+  for(; *s; s++){
+    if(*s >= '0' && *s <= '9')
+      d = *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      d = *s - 'a' + 10;
+    else if(*s >= 'A' && *s <= 'F')
+      d = *s - 'A' + 10;
+    else
+      return 0;
+    if(d >= base)
+      return 0;
+    m = m * base + d;
+  }
+  return m;
+}
+
+void
+usage(void)
+{
+  fprintf(2, "usage: taskset mask command [args...]\n");
+  fprintf(2, "       taskset -p mask pid\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 mask;
+
+  if(argc == 4 && strcmp(argv[1], "-p") == 0){
+    if((mask = parsemask(argv[2])) == 0)
+      usage();
+    if(setaffinity(atoi(argv[3]), mask) < 0){
+      fprintf(2, "taskset: cannot set affinity of %s\n", argv[3]);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  if(argc < 3 || (mask = parsemask(argv[1])) == 0)
+    usage();
+  if(setaffinity(0, mask) < 0){
+    fprintf(2, "taskset: no running CPU in mask %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
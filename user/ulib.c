@@ -1,6 +1,12 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/futex.h"
+#include "kernel/param.h"
+#include "kernel/rusage.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/usyscall.h"
 #include "user/user.h"
 
 //
@@ -63,6 +69,28 @@ strchr(const char *s, char c)
   return 0;
 }
 
+// does the 64-bit word v contain a zero byte?
+#define HASZERO(v) (((v) - 0x0101010101010101UL) & ~(v) & 0x8080808080808080UL)
+
+// a word at a time once p is aligned: XOR with c in
+// every byte turns a byte equal to c into a zero byte.
+void*
+memchr(const void *s, int c, uint n)
+{
+  const uchar *p = s;
+  uint64 pat = 0x0101010101010101UL * (uchar)c;
+
+  for(; n > 0 && ((uint64)p & 7); n--, p++)
+    if(*p == (uchar)c)
+      return (void*)p;
+  for(; n >= 8 && !HASZERO(*(uint64*)p ^ pat); n -= 8)
+    p += 8;
+  for(; n > 0; n--, p++)
+    if(*p == (uchar)c)
+      return (void*)p;
+  return 0;
+}
+
 char*
 gets(char *buf, int max)
 {
@@ -145,3 +173,171 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// what a new thread runs, kept at the top of its stack.
+struct threadstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static void
+threadstart(void *a)
+{
+  struct threadstart *t = a;
+
+  t->fn(t->arg);
+  _exit(0);   // not exit(): leave the streams to the process
+}
+
+// Run fn(arg) in a new thread that shares this process's
+// memory and file descriptors, on the size bytes of stack
+// at stack. The thread exits when fn returns.
+// Returns its pid, for join(), or -1.
+// (malloc() is not thread-safe; allocate stacks up front.)
+int
+thread_create(void (*fn)(void*), void *arg, void *stack, uint size)
+{
+  struct threadstart *t;
+
+  t = (struct threadstart*)(((uint64)stack + size - sizeof(*t)) & ~15L);
+  t->fn = fn;
+  t->arg = arg;
+  return clone(threadstart, t, t);
+}
+
+// Mutexes and condition variables for threads, which only
+// enter the kernel when they have to wait or to wake a waiter.
+// A mutex that is held is usually released soon by a thread
+// running on another CPU, so spin a while before sleeping.
+// The mutex follows Drepper's "Futexes Are Tricky".
+
+#define MUTEX_SPIN 100
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c, i;
+
+  for(i = 0; i < MUTEX_SPIN; i++){
+    if(*(volatile int*)&m->state == 0 &&
+       __sync_bool_compare_and_swap(&m->state, 0, 1))
+      return;
+  }
+
+  // mark it waited for, so that the holder's unlock
+  // wakes us, and sleep until it is free.
+  c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    // someone may be waiting.
+    __sync_lock_release(&m->state);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// Atomically release m and wait for a signal, then
+// reacquire m. Like all condition variables, it can
+// return without a signal; callers re-check in a loop.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = *(volatile int*)&c->seq;
+
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+
+  // other waiters may have been woken too; take m
+  // as if contended, so that our unlock wakes them.
+  while(__sync_lock_test_and_set(&m->state, 2) != 0)
+    futex(&m->state, FUTEX_WAIT, 2);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, -1);
+}
+
+// the time CSR, which counts TIMEBASE times a second from
+// boot. the kernel lets user mode read it, so this costs
+// no system call.
+uint64
+rdtime(void)
+{
+  uint64 x;
+
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+int
+clock_gettime(int clock, struct timespec *ts)
+{
+  struct rusage ru;
+  uint64 t;
+
+  if(clock == CLOCK_MONOTONIC)
+    t = rdtime();
+  else if(clock == CLOCK_PROCESS_CPUTIME_ID && getrusage(RUSAGE_SELF, &ru) == 0)
+    t = ru.utime + ru.stime;
+  else
+    return -1;
+  ts->tv_sec = t / TIMEBASE;
+  ts->tv_nsec = t % TIMEBASE * (1000000000 / TIMEBASE);
+  return 0;
+}
+
+// getpid() and uptime() need no system call: the kernel
+// maps this address space's pid at USYSCALL, and uptime()
+// is the time CSR counted in ticks, as sys_uptime() does.
+int
+getpid(void)
+{
+  struct usyscall *u = (struct usyscall*)USYSCALL;
+
+  if(u->threaded)
+    return _getpid();
+  return u->pid;
+}
+
+int
+uptime(void)
+{
+  return rdtime() / TICKINTERVAL;
+}
+
+// the kernel's counters, kept up to date in a page that
+// every process can read.
+struct kinfo*
+kinfo(void)
+{
+  return (struct kinfo*)KINFO;
+}
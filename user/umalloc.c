@@ -3,88 +3,256 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.
+//
+// Small requests are served from segregated free lists, one
+// per size class: malloc() pops the head of its class's list
+// and free() pushes onto it, both in constant time. An empty
+// list is refilled by carving a chunk from sbrk(). Small
+// blocks are not given back to the kernel, only reused by
+// later requests of the same class.
+//
+// Larger requests get a block to themselves, from a list of
+// free large blocks kept in address order so that neighbours
+// coalesce, or else from sbrk(). When enough free space
+// collects at the top of the heap, free() returns it with a
+// negative sbrk(). The kernel refuses that while other
+// threads share the address space; the space then stays on
+// the free list.
+//
+// Every block starts with a header holding its size in
+// bytes, header included. Not thread-safe.
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;   // next free block in its list
+    uint64 size;         // block size, with header
   } s;
-  Align x;
+  Align x[2];
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+#define HDR       sizeof(Header)
+#define MAXSMALL  2048            // largest small request
+#define CHUNK     4096            // bytes to carve per refill
+#define TRIM      (64*1024)       // free space at the top worth giving back
 
-void
-free(void *ap)
+static uint classes[] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, MAXSMALL
+};
+#define NCLASS (sizeof(classes)/sizeof(classes[0]))
+
+static uchar classof[MAXSMALL/16 + 1];   // request/16, rounded up, to class
+static Header *smallfree[NCLASS];
+static Header *largefree;                 // in address order
+static int ready;
+
+static void
+mallocinit(void)
 {
-  Header *bp, *p;
+  int c, i;
 
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  ready = 1;
+  for(c = 0, i = 0; i <= MAXSMALL/16; i++){
+    while(classes[c] < i*16)
+      c++;
+    classof[i] = c;
+  }
 }
 
-static Header*
-morecore(uint nu)
+// Grow the heap by n bytes, keeping blocks 16-byte aligned
+// even if someone else has called sbrk() with an odd size.
+static char*
+morecore(uint64 n)
 {
   char *p;
-  Header *hp;
+  uint64 pad;
+
+  pad = -(uint64)sbrk(0) % HDR;
+  if(n + pad > 0x7fffffff || (p = sbrk(n + pad)) == (char*)-1)
+    return 0;
+  return p + pad;
+}
+
+// Refill size class c's free list.
+static int
+smallfill(int c)
+{
+  uint64 bsize = classes[c] + HDR;
+  int i, n;
+  char *p;
+
+  n = CHUNK / bsize;
+  if(n < 4)
+    n = 4;
+  if((p = morecore(n * bsize)) == 0)
+    return -1;
+  for(i = 0; i < n; i++, p += bsize){
+    Header *h = (Header*)p;
+    h->s.size = bsize;
+    h->s.ptr = smallfree[c];
+    smallfree[c] = h;
+  }
+  return 0;
+}
+
+// Allocate a large block of size bytes, header included:
+// the best fit from the free list, or else a new one at the
+// top of the heap, reusing any free block that ends there.
+static void*
+largealloc(uint64 size)
+{
+  Header *p, **pp, **best, **last;
+  char *top;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
+  best = last = 0;
+  for(pp = &largefree; (p = *pp) != 0; pp = &p->s.ptr){
+    if(p->s.size >= size && (best == 0 || p->s.size < (*best)->s.size))
+      best = pp;
+    last = pp;
+  }
+
+  if(best){
+    p = *best;
+    if(p->s.size - size > MAXSMALL + HDR){
+      // take the tail, leaving the rest in place.
+      p->s.size -= size;
+      p = (Header*)((char*)p + p->s.size);
+      p->s.size = size;
+    } else {
+      *best = p->s.ptr;
+    }
+    return (void*)(p + 1);
+  }
+
+  top = sbrk(0);
+  if(last && (char*)*last + (*last)->s.size == top){
+    p = *last;
+    if(size - p->s.size > 0x7fffffff || sbrk(size - p->s.size) == (char*)-1)
+      return 0;
+    *last = 0;
+  } else if((p = (Header*)morecore(size)) == 0){
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  }
+  p->s.size = size;
+  return (void*)(p + 1);
+}
+
+// Put a large block on the free list, merging it with its
+// neighbours, and give the top of the heap back to the
+// kernel if enough of it is free.
+static void
+largeput(Header *bp)
+{
+  Header *p, *prev, **pp, **prevpp;
+
+  prev = 0;
+  prevpp = 0;
+  for(pp = &largefree; (p = *pp) != 0 && p < bp; pp = &p->s.ptr){
+    prev = p;
+    prevpp = pp;
+  }
+
+  if(p && (char*)bp + bp->s.size == (char*)p){
+    bp->s.size += p->s.size;
+    bp->s.ptr = p->s.ptr;
+  } else {
+    bp->s.ptr = p;
+  }
+  if(prev && (char*)prev + prev->s.size == (char*)bp){
+    prev->s.size += bp->s.size;
+    prev->s.ptr = bp->s.ptr;
+    bp = prev;
+    pp = prevpp;
+  } else {
+    *pp = bp;
+  }
+
+  if(bp->s.ptr == 0 && bp->s.size >= TRIM &&
+     (char*)bp + bp->s.size == sbrk(0) &&
+     sbrk(-(int)bp->s.size) != (char*)-1)
+    *pp = 0;
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+  int c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.size <= MAXSMALL + HDR){
+    c = classof[(bp->s.size - HDR) / 16];
+    bp->s.ptr = smallfree[c];
+    smallfree[c] = bp;
+  } else {
+    largeput(bp);
+  }
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  Header *p;
+  int c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  if(!ready)
+    mallocinit();
+  if(nbytes <= MAXSMALL){
+    c = classof[(nbytes + 15) / 16];
+    if(smallfree[c] == 0 && smallfill(c) < 0)
+      return 0;
+    p = smallfree[c];
+    smallfree[c] = p->s.ptr;
+    return (void*)(p + 1);
   }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+  return largealloc(((uint64)nbytes + 15) / 16 * 16 + HDR);
+}
+
+void*
+calloc(uint n, uint size)
+{
+  void *p;
+
+  if(size != 0 && n > 0xffffffff / size)
+    return 0;
+  if((p = malloc(n * size)) != 0)
+    memset(p, 0, n * size);
+  return p;
+}
+
+void*
+realloc(void *ap, uint nbytes)
+{
+  Header *bp;
+  uint64 have, size;
+  void *np;
+
+  if(ap == 0)
+    return malloc(nbytes);
+  bp = (Header*)ap - 1;
+  have = bp->s.size - HDR;
+  if(nbytes <= have)
+    return ap;
+
+  // a large block at the top of the heap can grow in place.
+  size = ((uint64)nbytes + 15) / 16 * 16 + HDR;
+  if(bp->s.size > MAXSMALL + HDR && nbytes > MAXSMALL &&
+     (char*)bp + bp->s.size == sbrk(0) &&
+     size - bp->s.size <= 0x7fffffff &&
+     sbrk(size - bp->s.size) != (char*)-1){
+    bp->s.size = size;
+    return ap;
   }
+
+  if((np = malloc(nbytes)) == 0)
+    return 0;
+  memmove(np, ap, have);
+  free(ap);
+  return np;
 }
@@ -1,16 +1,58 @@
 struct stat;
 struct sysinfo;
+struct cpustat;
+struct rusage;
+struct procstat;
+struct kinfo;
+
+// ulib.c: locks for threads made by clone().
+struct mutex {
+  int state;    // 0: free, 1: held, 2: held and maybe waited for
+};
+
+struct cond {
+  int seq;      // bumped by every signal
+};
+
+// ulib.c: clocks for clock_gettime().
+#define CLOCK_MONOTONIC          1   // time since boot
+#define CLOCK_PROCESS_CPUTIME_ID 2   // CPU time used by this process
+
+struct timespec {
+  uint64 tv_sec;
+  uint64 tv_nsec;
+};
+
+// stdio.c: buffered streams.
+#define BUFSIZ 1024
+#define EOF (-1)
+#define _IOFBF 0      // write when the buffer fills
+#define _IOLBF 1      // also write at the end of each line
+#define _IONBF 2      // write at the end of each call
+
+typedef struct iobuf {
+  int fd;
+  int mode;           // _IOFBF, _IOLBF, _IONBF, or -1 if not yet chosen
+  int flags;          // see stdio.c
+  char *buf;
+  uint size;          // of buf
+  uint pos;           // next byte of buf to read
+  uint len;           // bytes in buf
+  struct iobuf *next; // list of open streams
+} FILE;
+
+extern FILE *stdin, *stdout, *stderr;
 
 // system calls
-int fork(void);
-int exit(int) __attribute__((noreturn));
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
 int wait(int*);
 int pipe(int*);
 int write(int, const void*, int);
 int read(int, void*, int);
 int close(int);
 int kill(int);
-int exec(const char*, char**);
+int _exec(const char*, char**);
 int open(const char*, int);
 int mknod(const char*, short, short);
 int unlink(const char*);
@@ -19,13 +61,25 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
+int _getpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int _uptime(void);
 
 int trace(int);
 int sysinfo(struct sysinfo*);
+int ioctl(int, int, int);
+int nanosleep(uint64);
+int _clone(void (*)(void*), void*, void*);
+int join(int, int*);
+int futex(int*, int, int);
+int setaffinity(int, uint64);
+int cpustat(struct cpustat*, int);
+int getrusage(int, struct rusage*);
+int procstat(struct procstat*, int);
+int _spawn(char*, char**, int*, int);
+int prof(int, uint64, int);
+int backtrace(uint64*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -35,11 +89,49 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
+void ffprintf(FILE*, const char*, ...);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void* realloc(void*, uint);
+void* calloc(uint, uint);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
+void* memchr(const void*, int, uint);
 void *memcpy(void *, const void *, uint);
+int thread_create(void (*)(void*), void*, void*, uint);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+uint64 rdtime(void);
+int clock_gettime(int, struct timespec*);
+int getpid(void);
+int uptime(void);
+struct kinfo* kinfo(void);
+
+// stdio.c
+int fork(void);
+int exit(int) __attribute__((noreturn));
+int exec(const char*, char**);
+int spawn(char*, char**, int*, int);
+int clone(void (*)(void*), void*, void*);
+FILE* fopen(const char*, const char*);
+FILE* fdopen(int, const char*);
+int fclose(FILE*);
+int fflush(FILE*);
+int setvbuf(FILE*, char*, int, uint);
+int fgetc(FILE*);
+char* fgets(char*, int, FILE*);
+uint fread(void*, uint, uint, FILE*);
+int fputc(int, FILE*);
+int fputs(const char*, FILE*);
+uint fwrite(const void*, uint, uint, FILE*);
+int feof(FILE*);
+int ferror(FILE*);
+int fileno(FILE*);
@@ -7,6 +7,11 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/cpustat.h"
+#include "kernel/rusage.h"
+#include "kernel/sysinfo.h"
+#include "kernel/usyscall.h"
+#include "kernel/prof.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2571,6 +2576,967 @@ badarg(char *s)
   exit(0);
 }
 
+// threads made by clone() share memory and file
+// descriptors; join() reaps them, and wait() does not.
+int clonevar;
+int clonefds[2];
+char clonestack[4096];
+
+void
+clonechild(void *arg)
+{
+  clonevar = (uint64)arg;
+  write(clonefds[1], "x", 1);
+  // closes it for the parent too.
+  close(clonefds[1]);
+}
+
+void
+clonetest(char *s)
+{
+  int tid, xstatus;
+  char c;
+
+  if(pipe(clonefds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  tid = thread_create(clonechild, (void*)42, clonestack, sizeof(clonestack));
+  if(tid < 0){
+    printf("%s: thread_create failed\n", s);
+    exit(1);
+  }
+  if(wait(0) != -1){
+    printf("%s: wait() reaped a thread\n", s);
+    exit(1);
+  }
+  if(join(tid, &xstatus) != tid || xstatus != 0){
+    printf("%s: join failed\n", s);
+    exit(1);
+  }
+  if(clonevar != 42){
+    printf("%s: thread did not share memory\n", s);
+    exit(1);
+  }
+  if(read(clonefds[0], &c, 1) != 1 || c != 'x' ||
+     read(clonefds[0], &c, 1) != 0){
+    printf("%s: thread did not share descriptors\n", s);
+    exit(1);
+  }
+  if(join(tid, 0) != -1){
+    printf("%s: joined twice\n", s);
+    exit(1);
+  }
+  close(clonefds[0]);
+}
+
+// when the main thread exits, its threads go too, and
+// are reaped by the time the parent's wait() returns.
+void
+spinthread(void *arg)
+{
+  for(;;)
+    ;
+}
+
+void
+threadexittest(char *s)
+{
+  int p[2], pid, tid;
+
+  if(pipe(p) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    tid = thread_create(spinthread, 0, clonestack, sizeof(clonestack));
+    write(p[1], &tid, sizeof(tid));
+    exit(0);
+  }
+  close(p[1]);
+  if(read(p[0], &tid, sizeof(tid)) != sizeof(tid) || tid < 0){
+    printf("%s: thread_create failed\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  if(wait(0) != pid){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  if(kill(tid) != -1){
+    printf("%s: thread %d outlived its process\n", s, tid);
+    exit(1);
+  }
+}
+
+// threads may printf() at once; clone() flushes what was
+// buffered before, and none of the output is lost.
+char printstacks[2][4096];
+
+void
+printthread(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 200; i++)
+    printf("0123456789\n");
+}
+
+void
+threadprinttest(char *s)
+{
+  static char buf[512];
+  int p[2], pid, tid[2], i, n, total;
+
+  if(pipe(p) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    dup(p[1]);
+    close(p[0]);
+    close(p[1]);
+    printf("start\n");   // buffered: stdout is a pipe
+    for(i = 0; i < 2; i++)
+      tid[i] = thread_create(printthread, 0, printstacks[i], sizeof(printstacks[i]));
+    printthread(0);
+    for(i = 0; i < 2; i++)
+      if(tid[i] < 0 || join(tid[i], 0) != tid[i])
+        exit(1);
+    exit(0);
+  }
+  close(p[1]);
+  total = 0;
+  while((n = read(p[0], buf, sizeof(buf))) > 0){
+    if(total == 0 && (n < 6 || memcmp(buf, "start\n", 6) != 0)){
+      printf("%s: output before clone() not first\n", s);
+      exit(1);
+    }
+    total += n;
+  }
+  close(p[0]);
+  wait(0);
+  if(total != 6 + 3*200*11){
+    printf("%s: threads printed %d bytes, not %d\n", s, total, 6 + 3*200*11);
+    exit(1);
+  }
+}
+
+// a process pinned to CPU 0 still runs, and so do its children.
+// a runnable child moved off CPU 0 runs on the CPU it is moved to.
+void
+affinitytest(char *s)
+{
+  struct cpustat cs[NCPU];
+  int pid, xstatus;
+
+  if(setaffinity(0, 0) != -1 || setaffinity(1000000, 1) != -1){
+    printf("%s: bad setaffinity succeeded\n", s);
+    exit(1);
+  }
+  if(setaffinity(0, 1) != 0){
+    printf("%s: setaffinity failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < 10; i++)
+      sleep(0);
+    exit(7);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7){
+    printf("%s: pinned child did not run\n", s);
+    exit(1);
+  }
+  if(cpustat(cs, NCPU) != NCPU || !cs[0].online || cs[0].busy == 0){
+    printf("%s: cpustat failed\n", s);
+    exit(1);
+  }
+
+  // the child is queued on CPU 0, and the parent does not
+  // yield before moving it to CPU 1.
+  if(cs[1].online){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(8);
+    if(setaffinity(pid, 2) != 0){
+      printf("%s: setaffinity of child failed\n", s);
+      exit(1);
+    }
+    if(wait(&xstatus) != pid || xstatus != 8){
+      printf("%s: repinned child did not run\n", s);
+      exit(1);
+    }
+  }
+  setaffinity(0, ~0UL);
+}
+
+// a reaped child's CPU time and system calls are
+// added to the parent's RUSAGE_CHILDREN totals.
+struct procstat rusageps[32];
+
+void
+rusagetest(char *s)
+{
+  struct rusage before, after, self;
+  struct procstat *ps = rusageps;
+  int nps = sizeof(rusageps) / sizeof(rusageps[0]);
+  int i, n, pid, found;
+
+  if(getrusage(RUSAGE_CHILDREN, &before) < 0 || getrusage(5, &before) != -1){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    int t0 = uptime();
+    volatile int x = 0;
+    while(uptime() - t0 < 2)
+      x++;
+    exit(0);
+  }
+  wait(0);
+  if(getrusage(RUSAGE_CHILDREN, &after) < 0 ||
+     after.utime <= before.utime || after.nsyscall <= before.nsyscall){
+    printf("%s: child usage not collected\n", s);
+    exit(1);
+  }
+  if(getrusage(RUSAGE_SELF, &self) < 0 || self.nsyscall == 0 || self.npage == 0){
+    printf("%s: no usage of self\n", s);
+    exit(1);
+  }
+
+  n = procstat(ps, nps);
+  found = 0;
+  for(i = 0; i < n; i++)
+    if(ps[i].pid == getpid() && strcmp(ps[i].state, "run   ") == 0)
+      found = 1;
+  if(n <= 0 || (!found && n < nps)){
+    printf("%s: procstat did not list us\n", s);
+    exit(1);
+  }
+}
+
+// spawn() runs a program with just the descriptors it is given.
+void
+spawntest(char *s)
+{
+  char *argv[] = { "echo", "spawned", 0 };
+  char buf[32];
+  int fds[3], p[2], pid, xstatus, n, m;
+
+  if(pipe(p) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fds[0] = -1;
+  fds[1] = p[1];
+  fds[2] = 2;
+  if((pid = spawn("echo", argv, fds, 3)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(p[1]);
+  n = 0;
+  while((m = read(p[0], buf + n, sizeof(buf) - 1 - n)) > 0)
+    n += m;
+  buf[n] = 0;
+  close(p[0]);
+  if(wait(&xstatus) != pid || xstatus != 0 || strcmp(buf, "spawned\n") != 0){
+    printf("%s: spawned echo misbehaved\n", s);
+    exit(1);
+  }
+
+  if(spawn("nosuchprogram", argv, 0, 0) != -1){
+    printf("%s: spawned a missing program\n", s);
+    exit(1);
+  }
+  fds[1] = 100;
+  if(spawn("echo", argv, fds, 3) != -1){
+    printf("%s: spawn took a closed descriptor\n", s);
+    exit(1);
+  }
+}
+
+// malloc() size classes, realloc(), calloc(), and giving
+// large blocks back to the kernel.
+void
+malloctest(char *s)
+{
+  char *a[64], *b, *top;
+  int i, j;
+
+  for(i = 0; i < 64; i++){
+    if((a[i] = malloc(i * 37)) == 0){
+      printf("%s: malloc(%d) failed\n", s, i * 37);
+      exit(1);
+    }
+    if((uint64)a[i] % 16 != 0){
+      printf("%s: malloc(%d) misaligned\n", s, i * 37);
+      exit(1);
+    }
+    memset(a[i], i, i * 37);
+  }
+  for(i = 0; i < 64; i++){
+    for(j = 0; j < i * 37; j++)
+      if(a[i][j] != (char)i){
+        printf("%s: blocks overlap\n", s);
+        exit(1);
+      }
+    free(a[i]);
+  }
+
+  if((b = calloc(100, 100)) == 0){
+    printf("%s: calloc failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100*100; i++)
+    if(b[i] != 0){
+      printf("%s: calloc not zeroed\n", s);
+      exit(1);
+    }
+  if(calloc(0x10000, 0x10000) != 0){
+    printf("%s: calloc overflow not caught\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++)
+    b[i] = i;
+  for(i = 1; i <= 20; i++){
+    if((b = realloc(b, i * 3000)) == 0){
+      printf("%s: realloc failed\n", s);
+      exit(1);
+    }
+    b[i * 3000 - 1] = 1;
+  }
+  for(i = 0; i < 100; i++)
+    if(b[i] != i){
+      printf("%s: realloc lost data\n", s);
+      exit(1);
+    }
+  free(b);
+
+  top = sbrk(0);
+  for(i = 0; i < 8; i++)
+    a[i] = malloc(100*1024);
+  for(i = 0; i < 8; i++)
+    if(a[i] == 0){
+      printf("%s: large malloc failed\n", s);
+      exit(1);
+    }
+  for(i = 0; i < 8; i++)
+    free(a[i]);
+  if(sbrk(0) > top){
+    printf("%s: large blocks not given back\n", s);
+    exit(1);
+  }
+}
+
+// ioctl() works only on the console, and raw mode ends
+// when the process that set it closes the console or exits.
+void
+ioctltest(char *s)
+{
+  int fd, fd1, p[2], pid, xstatus;
+
+  if((fd = open("console", O_RDWR)) < 0){
+    printf("%s: open console failed\n", s);
+    exit(1);
+  }
+  if(ioctl(fd, CONSOLE_SETRAW, 1) != 0 || ioctl(fd, CONSOLE_GETRAW, 0) != 1 ||
+     ioctl(fd, CONSOLE_SETRAW, 0) != 0 || ioctl(fd, CONSOLE_GETRAW, 0) != 0){
+    printf("%s: console ioctl failed\n", s);
+    exit(1);
+  }
+  if(ioctl(fd, 99, 0) != -1){
+    printf("%s: bad ioctl request succeeded\n", s);
+    exit(1);
+  }
+
+  if(pipe(p) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if((fd1 = open("ioctlfile", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  if(ioctl(p[0], CONSOLE_SETRAW, 1) != -1 || ioctl(fd1, CONSOLE_SETRAW, 1) != -1){
+    printf("%s: ioctl on a pipe or file succeeded\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  close(p[1]);
+  close(fd1);
+  unlink("ioctlfile");
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    ioctl(fd, CONSOLE_SETRAW, 1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(ioctl(fd, CONSOLE_GETRAW, 0) != 0){
+    printf("%s: raw mode outlived its process\n", s);
+    exit(1);
+  }
+
+  fd1 = dup(fd);
+  ioctl(fd1, CONSOLE_SETRAW, 1);
+  close(fd1);
+  if(ioctl(fd, CONSOLE_GETRAW, 0) != 0){
+    printf("%s: raw mode outlived close\n", s);
+    exit(1);
+  }
+  close(fd);
+}
+
+// buffered streams: write and read back a file, and
+// don't write buffered output twice across fork().
+void
+stdiotest(char *s)
+{
+  static char rbuf[100];   // fclose() must not free() it
+  char line[64];
+  FILE *f;
+  int i, pid, c;
+
+  if((f = fopen("stdiotest", "w")) == 0){
+    printf("%s: fopen w failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 500; i++)
+    ffprintf(f, "line %d\n", i);
+  fputs("before fork ", f);
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+  fputs("after\n", f);
+  if(fclose(f) != 0){
+    printf("%s: fclose failed\n", s);
+    exit(1);
+  }
+
+  if((f = fopen("stdiotest", "r")) == 0 ||
+     setvbuf(f, rbuf, _IOFBF, sizeof(rbuf)) != 0){
+    printf("%s: fopen r failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 500; i++){
+    if(fgets(line, sizeof(line), f) == 0 || atoi(line + 5) != i){
+      printf("%s: line %d wrong\n", s, i);
+      exit(1);
+    }
+    if(i == 0 && memcmp(rbuf, "line 0\n", 7) != 0){
+      printf("%s: setvbuf buffer not used\n", s);
+      exit(1);
+    }
+  }
+  if(fgets(line, sizeof(line), f) == 0 ||
+     strcmp(line, "before fork after\n") != 0 ||
+     (c = fgetc(f)) != EOF || !feof(f)){
+    printf("%s: output around fork() wrong\n", s);
+    exit(1);
+  }
+  fclose(f);
+  unlink("stdiotest");
+  if(fopen("stdiotest", "r") != 0){
+    printf("%s: opened a missing file\n", s);
+    exit(1);
+  }
+}
+
+// copy the file src to dst.
+void
+lazycopy(char *s, char *src, char *dst)
+{
+  static char buf[1024];
+  int fd0, fd1, n;
+
+  if((fd0 = open(src, O_RDONLY)) < 0 ||
+     (fd1 = open(dst, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    printf("%s: cannot copy %s\n", s, src);
+    exit(1);
+  }
+  while((n = read(fd0, buf, sizeof(buf))) > 0)
+    if(write(fd1, buf, n) != n){
+      printf("%s: write %s failed\n", s, dst);
+      exit(1);
+    }
+  close(fd0);
+  close(fd1);
+}
+
+// spawn argv with its output going to out[].
+void
+lazyrun(char *s, char **argv, char *out, int n)
+{
+  int fds[3], p[2], k, m, xstatus;
+
+  if(pipe(p) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fds[0] = -1;
+  fds[1] = p[1];
+  fds[2] = 2;
+  if(spawn(argv[0], argv, fds, 3) < 0){
+    printf("%s: spawn %s failed\n", s, argv[0]);
+    exit(1);
+  }
+  close(p[1]);
+  k = 0;
+  while((m = read(p[0], out + k, n - 1 - k)) > 0)
+    k += m;
+  out[k] = 0;
+  close(p[0]);
+  wait(&xstatus);
+}
+
+char lazybuf[3*4096];
+
+// exec() loads program pages on first touch, and shares
+// text pages between runs until the file changes. a file
+// can't change while it runs.
+void
+lazyexectest(char *s)
+{
+  char *argv[3], out[32];
+  struct rusage before, after;
+  int p[2], fds[3], fd, pid;
+
+  // the kernel, not the program, touches lazybuf first.
+  if(pipe(p) != 0 || write(p[1], "lazy", 4) != 4 ||
+     read(p[0], lazybuf + 4096, 4) != 4 ||
+     memcmp(lazybuf + 4096, "lazy", 4) != 0){
+    printf("%s: read into untouched bss failed\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  close(p[1]);
+
+  getrusage(RUSAGE_CHILDREN, &before);
+  lazycopy(s, "echo", "lazyprog");
+  argv[0] = "lazyprog";
+  argv[1] = "one";
+  argv[2] = 0;
+  lazyrun(s, argv, out, sizeof(out));
+  if(strcmp(out, "one\n") != 0){
+    printf("%s: lazyprog as echo said %s\n", s, out);
+    exit(1);
+  }
+  getrusage(RUSAGE_CHILDREN, &after);
+  if(after.nfault <= before.nfault){
+    printf("%s: no pages faulted in\n", s);
+    exit(1);
+  }
+
+  // replace the program; its cached text must not be reused.
+  if((fd = open("lazyin", O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+     write(fd, "two\n", 4) != 4){
+    printf("%s: cannot create lazyin\n", s);
+    exit(1);
+  }
+  close(fd);
+  lazycopy(s, "cat", "lazyprog");
+  argv[1] = "lazyin";
+  lazyrun(s, argv, out, sizeof(out));
+  if(strcmp(out, "two\n") != 0){
+    printf("%s: lazyprog as cat said %s\n", s, out);
+    exit(1);
+  }
+
+  // while cat waits for input, lazyprog can't be rewritten.
+  if(pipe(p) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fds[0] = p[0];
+  fds[1] = -1;
+  fds[2] = 2;
+  argv[1] = 0;
+  if((pid = spawn(argv[0], argv, fds, 3)) < 0){
+    printf("%s: spawn lazyprog failed\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  if((fd = open("lazyprog", O_CREATE|O_TRUNC|O_WRONLY)) >= 0){
+    printf("%s: truncated a running program\n", s);
+    exit(1);
+  }
+  if((fd = open("lazyprog", O_WRONLY)) < 0){
+    printf("%s: cannot open lazyprog\n", s);
+    exit(1);
+  }
+  if(write(fd, "xxxx", 4) >= 0){
+    printf("%s: wrote to a running program\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(p[1]);
+  if(wait(0) != pid){
+    printf("%s: wait for lazyprog failed\n", s);
+    exit(1);
+  }
+  lazycopy(s, "echo", "lazyprog");   // may write once it has exited
+
+  unlink("lazyprog");
+  unlink("lazyin");
+}
+
+// grep's compiled matcher and its -c, -n and -v options.
+void
+greptest(char *s)
+{
+  static char *text = "abc\nadcx\nc\nxxxxxxxxxxxxxxxxxxxxxxxxy\n\n";
+  static char *cases[][3] = {
+    // option, pattern, output
+    { 0, "b*c$", "abc\nc\n" },
+    { 0, "^a.c", "abc\nadcx\n" },
+    { "-n", "x", "2:adcx\n4:xxxxxxxxxxxxxxxxxxxxxxxxy\n" },
+    { "-c", "x*x*x*x*x*x*x*x*x*x*x*z", "0\n" },
+    { "-vc", "c", "2\n" },
+  };
+  char *argv[5], out[64];
+  int fd, i, k;
+
+  if((fd = open("greptest", O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+     write(fd, text, strlen(text)) != strlen(text)){
+    printf("%s: cannot create greptest\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < sizeof(cases)/sizeof(cases[0]); i++){
+    k = 0;
+    argv[k++] = "grep";
+    if(cases[i][0])
+      argv[k++] = cases[i][0];
+    argv[k++] = cases[i][1];
+    argv[k++] = "greptest";
+    argv[k] = 0;
+    lazyrun(s, argv, out, sizeof(out));
+    if(strcmp(out, cases[i][2]) != 0){
+      printf("%s: grep %s said %s\n", s, cases[i][1], out);
+      exit(1);
+    }
+  }
+  unlink("greptest");
+}
+
+// wc counts files in parallel, but reports them in order.
+void
+wctest(char *s)
+{
+  static char *text[3] = { "one two\nthree\n", "", "\t x\0y  zz" };
+  char *argv[7], out[64], name[4];
+  int fd, i;
+
+  for(i = 0; i < 3; i++){
+    name[0] = 'w';
+    name[1] = 'c';
+    name[2] = '0' + i;
+    name[3] = 0;
+    if((fd = open(name, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      printf("%s: cannot create %s\n", s, name);
+      exit(1);
+    }
+    write(fd, text[i], i == 2 ? 10 : strlen(text[i]));
+    close(fd);
+  }
+  argv[0] = "wc";
+  argv[1] = "-j";
+  argv[2] = "2";
+  argv[3] = "wc0";
+  argv[4] = "wc1";
+  argv[5] = "wc2";
+  argv[6] = 0;
+  lazyrun(s, argv, out, sizeof(out));
+  if(strcmp(out, "2 3 14 wc0\n0 0 0 wc1\n0 3 10 wc2\n") != 0){
+    printf("%s: wc said %s\n", s, out);
+    exit(1);
+  }
+  for(i = 0; i < 3; i++){
+    name[2] = '0' + i;
+    unlink(name);
+  }
+}
+
+// sh runs builtins itself and starts each stage of a pipeline,
+// even one that needs a copy of the shell, as its own child.
+void
+shtest(char *s)
+{
+  static char *script =
+    "echo a b > shout\n"
+    "cat shout | cat | wc\n"
+    "(echo c; echo d) | grep d\n"
+    "echo x | exit 4\n"      // builtins in a pipeline don't
+    "cd / | cat\n"           // affect the shell
+    "cat shout\n"
+    "exit 3\n"
+    "echo notreached\n";
+  char out[64];
+  char *argv[] = { "sh", 0 };
+  int fds[3], p[2], fd, k, m, xstatus;
+
+  if((fd = open("shin", O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+     write(fd, script, strlen(script)) != strlen(script)){
+    printf("%s: cannot create shin\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("shin", O_RDONLY)) < 0 || pipe(p) != 0){
+    printf("%s: cannot open shin\n", s);
+    exit(1);
+  }
+  fds[0] = fd;
+  fds[1] = p[1];
+  fds[2] = p[1];   // prompts, and any complaints
+  if(spawn("sh", argv, fds, 3) < 0){
+    printf("%s: spawn sh failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(p[1]);
+  k = 0;
+  while((m = read(p[0], out + k, sizeof(out) - 1 - k)) > 0)
+    k += m;
+  out[k] = 0;
+  close(p[0]);
+  wait(&xstatus);
+  if(strcmp(out, "$ $ 1 2 4 \n$ d\n$ $ $ a b\n$ ") != 0){
+    printf("%s: sh said %s\n", s, out);
+    exit(1);
+  }
+  if(xstatus != 3){
+    printf("%s: sh exit status %d, not 3\n", s, xstatus);
+    exit(1);
+  }
+  unlink("shin");
+  unlink("shout");
+}
+
+// user mode reads the time CSR without a system call.
+void
+clocktest(char *s)
+{
+  struct rusage r0, r1;
+  struct timespec ts0, ts1;
+  uint64 t0, t1;
+  int i;
+
+  getrusage(RUSAGE_SELF, &r0);
+  t0 = rdtime();
+  for(i = 0; i < 1000; i++){
+    if((t1 = rdtime()) < t0){
+      printf("%s: time went backwards\n", s);
+      exit(1);
+    }
+    t0 = t1;
+  }
+  if(clock_gettime(CLOCK_MONOTONIC, &ts0) < 0){
+    printf("%s: clock_gettime failed\n", s);
+    exit(1);
+  }
+  getrusage(RUSAGE_SELF, &r1);
+  if(r1.nsyscall - r0.nsyscall != 1){
+    printf("%s: reading the clock made %d system calls\n", s,
+           (int)(r1.nsyscall - r0.nsyscall - 1));
+    exit(1);
+  }
+
+  sleep(2);
+  t1 = rdtime();
+  clock_gettime(CLOCK_MONOTONIC, &ts1);
+  if(t1 - t0 < TICKINTERVAL || ts0.tv_nsec >= 1000000000 ||
+     ts1.tv_sec * 1000000000 + ts1.tv_nsec <= ts0.tv_sec * 1000000000 + ts0.tv_nsec){
+    printf("%s: clock did not advance during sleep\n", s);
+    exit(1);
+  }
+  if(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts0) < 0 ||
+     clock_gettime(99, &ts0) != -1){
+    printf("%s: clock_gettime clocks wrong\n", s);
+    exit(1);
+  }
+}
+
+// getpid() reads the pid from the read-only USYSCALL page,
+// until a thread shares the address space; the KINFO page
+// agrees with sysinfo().
+char usysstack[4096];
+
+void
+usysthread(void *arg)
+{
+  *(int*)arg = getpid();
+}
+
+void
+usyscalltest(char *s)
+{
+  struct sysinfo info;
+  uint64 before;
+  int pid, tid, xstatus, tpid;
+
+  if(getpid() != _getpid()){
+    printf("%s: getpid() %d, system call says %d\n", s, getpid(), _getpid());
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(getpid() == _getpid() ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child has wrong pid\n", s);
+    exit(1);
+  }
+
+  // the page is read-only.
+  pid = fork();
+  if(pid == 0){
+    *(int*)USYSCALL = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: wrote the usyscall page\n", s);
+    exit(1);
+  }
+
+  if(sysinfo(&info) < 0 || info.nproc != kinfo()->nproc ||
+     info.freemem != kinfo()->freemem){
+    printf("%s: kinfo disagrees with sysinfo\n", s);
+    exit(1);
+  }
+  before = kinfo()->freemem;
+  if(sbrk(10*4096) == (char*)-1 || kinfo()->freemem > before - 10*4096){
+    printf("%s: kinfo freemem did not drop\n", s);
+    exit(1);
+  }
+  sbrk(-10*4096);
+
+  tid = thread_create(usysthread, &tpid, usysstack, sizeof(usysstack));
+  if(tid < 0 || join(tid, 0) != tid){
+    printf("%s: thread_create failed\n", s);
+    exit(1);
+  }
+  if(tpid != tid || getpid() != _getpid()){
+    printf("%s: wrong pid with threads\n", s);
+    exit(1);
+  }
+}
+
+struct profsample profbuf[256];
+
+// the profiler sees this process spinning in user space.
+void
+proftest(char *s)
+{
+  uint64 t0;
+  int i, n, mine;
+  volatile int x = 0;
+
+  if(prof(99, 0, 0) != -1){
+    printf("%s: prof accepted a bad command\n", s);
+    exit(1);
+  }
+  if(prof(PROF_START, 0, 0) < 0){
+    printf("%s: PROF_START failed\n", s);
+    exit(1);
+  }
+  mine = 0;
+  t0 = rdtime();
+  while(rdtime() - t0 < 20*PROFTICK){
+    for(i = 0; i < 1000; i++)
+      x++;
+    n = prof(PROF_READ, (uint64)profbuf, sizeof(profbuf)/sizeof(profbuf[0]));
+    for(i = 0; i < n; i++)
+      if(profbuf[i].pid == getpid() && profbuf[i].user &&
+         profbuf[i].pc < (uint64)sbrk(0))
+        mine++;
+  }
+  prof(PROF_STOP, 0, 0);
+  if(mine == 0){
+    printf("%s: no samples of this process\n", s);
+    exit(1);
+  }
+}
+
+struct procstat btps[64];
+
+// backtrace() walks the kernel stack, and the kernel keeps
+// track of how deep each process's stack has been.
+void
+backtracetest(char *s)
+{
+  uint64 pcs[8];
+  int i, n;
+
+  n = backtrace(pcs, 8);
+  if(n < 2){
+    printf("%s: backtrace() found %d frames\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(pcs[i] < KERNBASE || pcs[i] >= PHYSTOP){
+      printf("%s: return address %p is not in the kernel\n", s, pcs[i]);
+      exit(1);
+    }
+  }
+  if(backtrace(pcs, -1) != -1){
+    printf("%s: backtrace() took a negative count\n", s);
+    exit(1);
+  }
+
+  sleep(1);
+  n = procstat(btps, sizeof(btps)/sizeof(btps[0]));
+  for(i = 0; i < n; i++)
+    if(btps[i].pid == getpid())
+      break;
+  if(i == n){
+    printf("%s: procstat did not list us\n", s);
+    exit(1);
+  }
+  if(btps[i].maxstack == 0 || btps[i].maxstack >= 4096){
+    printf("%s: kernel stack depth %d\n", s, (int)btps[i].maxstack);
+    exit(1);
+  }
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2598,6 +3564,23 @@ struct test {
   {preempt, "preempt"},
   {exitwait, "exitwait"},
   {reparent, "reparent" },
+  {clonetest, "clonetest"},
+  {threadprinttest, "threadprinttest"},
+  {threadexittest, "threadexittest"},
+  {affinitytest, "affinitytest"},
+  {rusagetest, "rusagetest"},
+  {spawntest, "spawntest"},
+  {lazyexectest, "lazyexec"},
+  {malloctest, "malloctest"},
+  {ioctltest, "ioctltest"},
+  {stdiotest, "stdiotest"},
+  {greptest, "greptest"},
+  {wctest, "wctest"},
+  {shtest, "shtest"},
+  {clocktest, "clocktest"},
+  {usyscalltest, "usyscalltest"},
+  {proftest, "proftest"},
+  {backtracetest, "backtracetest"},
   {twochildren, "twochildren"},
   {forkfork, "forkfork"},
   {forkforkfork, "forkforkfork"},
@@ -2924,6 +3907,105 @@ outofinodes(char *s)
   }
 }
 
+// the process table grows as needed: run hundreds
+// of processes at once.
+void
+manyprocs(char *s)
+{
+  enum { N = 300 };
+  int fds[2], i, pid;
+  char c;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork %d failed\n", s, i);
+      close(fds[1]);
+      exit(1);
+    }
+    if(pid == 0){
+      // hold on until the parent has made all N.
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < N; i++){
+    if(wait(0) < 0){
+      printf("%s: wait stopped early\n", s);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+}
+
+// descriptor tables grow as needed: hold thousands
+// of files open at once, hundreds per process.
+void
+manyfiles(char *s)
+{
+  enum { NCHILD = 8, NFD = 500 };
+  int ready[2], done[2], i, j, fd, pid, xstatus;
+  char c;
+
+  unlink("manyfiles");
+  fd = open("manyfiles", O_CREATE|O_WRONLY);
+  if(fd < 0 || write(fd, "x", 1) != 1){
+    printf("%s: cannot create manyfiles\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(ready) != 0 || pipe(done) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(done[1]);
+      for(j = 0; j < NFD; j++){
+        if((fd = open("manyfiles", O_RDONLY)) < 0){
+          printf("%s: open %d failed\n", s, j);
+          exit(1);
+        }
+      }
+      if(read(fd, &c, 1) != 1 || c != 'x'){
+        printf("%s: read from fd %d failed\n", s, fd);
+        exit(1);
+      }
+      // keep them open until every child has its NFD.
+      write(ready[1], "r", 1);
+      read(done[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(done[0]);
+  for(i = 0; i < NCHILD; i++){
+    if(read(ready[0], &c, 1) != 1)
+      break;
+  }
+  close(done[1]);
+  close(ready[0]);
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  unlink("manyfiles");
+}
+
 struct test slowtests[] = {
   {bigdir, "bigdir"},
   {manywrites, "manywrites"},
@@ -2931,6 +4013,8 @@ struct test slowtests[] = {
   {execout, "execout"},
   {diskfull, "diskfull"},
   {outofinodes, "outofinodes"},
+  {manyprocs, "manyprocs"},
+  {manyfiles, "manyfiles"},
     
   { 0, 0},
 };
@@ -1,55 +1,194 @@
+// Count lines, words and bytes.
+//
+// usage: wc [-j jobs] [file ...]
+//
+// With several files, wc forks up to one worker per CPU (or
+// jobs of them), each counting every jobs'th file and sending
+// its counts back through a pipe; the counts are printed in
+// the order the files were named.
+
 #include "kernel/types.h"
 #include "kernel/stat.h"
-#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/cpustat.h"
 #include "user/user.h"
 
-char buf[512];
+// does the 64-bit word v contain a byte less than n (n <= 128)?
+#define HASLESS(v, n) (((v) - 0x0101010101010101UL * (n)) & ~(v) & 0x8080808080808080UL)
+
+struct count {
+  int l, w, c;
+  int err;          // 1 if the file would not open, 2 on a read error
+};
 
+char buf[32*1024];
+uchar space[256];   // bytes that separate words
+struct cpustat cs[NCPU];
+
+// count the bytes in [p, e) into n. *inword says whether
+// the last byte counted so far was part of a word.
 void
-wc(int fd, char *name)
+count(uchar *p, uchar *e, struct count *n, int *inword)
 {
-  int i, n;
-  int l, w, c, inword;
+  int in = *inword, sp;
 
-  l = w = c = 0;
-  inword = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i=0; i<n; i++){
-      c++;
-      if(buf[i] == '\n')
-        l++;
-      if(strchr(" \r\t\n\v", buf[i]))
-        inword = 0;
-      else if(!inword){
-        w++;
-        inword = 1;
-      }
+  n->c += e - p;
+  while(p < e){
+    // every byte that is a space or a newline is below
+    // '!', so an aligned word with none is all one word.
+    if(((uint64)p & 7) == 0 && p + 8 <= e &&
+       !HASLESS(*(uint64*)p, '!')){
+      n->w += !in;
+      in = 1;
+      p += 8;
+      continue;
     }
+    sp = space[*p];
+    n->l += *p == '\n';
+    n->w += !sp & !in;
+    in = !sp;
+    p++;
   }
-  if(n < 0){
+  *inword = in;
+}
+
+void
+wc(FILE *f, struct count *n)
+{
+  int k, inword;
+
+  memset(n, 0, sizeof(*n));
+  inword = 0;
+  while((k = fread(buf, 1, sizeof(buf), f)) > 0)
+    count((uchar*)buf, (uchar*)buf + k, n, &inword);
+  if(ferror(f))
+    n->err = 2;
+}
+
+void
+wcfile(char *name, struct count *n)
+{
+  FILE *f;
+
+  if((f = fopen(name, "r")) == 0){
+    memset(n, 0, sizeof(*n));
+    n->err = 1;
+    return;
+  }
+  wc(f, n);
+  fclose(f);
+}
+
+void
+report(struct count *n, char *name)
+{
+  if(n->err == 1){
+    printf("wc: cannot open %s\n", name);
+    exit(1);
+  }
+  if(n->err){
     printf("wc: read error\n");
     exit(1);
   }
-  printf("%d %d %d %s\n", l, w, c, name);
+  printf("%d %d %d %s\n", n->l, n->w, n->c, name);
+}
+
+// online CPUs, or 1 if that can't be found.
+int
+ncpu(void)
+{
+  int i, n, k;
+
+  if((n = cpustat(cs, NCPU)) <= 0)
+    return 1;
+  if(n > NCPU)
+    n = NCPU;
+  for(i = k = 0; i < n; i++)
+    k += cs[i].online;
+  return k > 0 ? k : 1;
+}
+
+// count nfile files with jobs worker processes.
+void
+parallel(char **files, int nfile, int jobs)
+{
+  int fds[NCPU], p[2], i, j;
+  struct count n;
+
+  for(j = 0; j < jobs; j++){
+    if(pipe(p) < 0){
+      fprintf(2, "wc: pipe failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "wc: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(p[0]);
+      for(i = j; i < nfile; i += jobs){
+        wcfile(files[i], &n);
+        if(write(p[1], &n, sizeof(n)) != sizeof(n))
+          exit(1);
+      }
+      exit(0);
+    }
+    close(p[1]);
+    fds[j] = p[0];
+  }
+
+  for(i = 0; i < nfile; i++){
+    if(read(fds[i % jobs], &n, sizeof(n)) != sizeof(n))
+      n.err = 2;
+    report(&n, files[i]);
+  }
+  for(j = 0; j < jobs; j++){
+    close(fds[j]);
+    wait(0);
+  }
 }
 
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  struct count n;
+  int i, jobs;
+
+  for(i = 0; i < sizeof(space); i++)
+    space[i] = strchr(" \r\t\n\v", i) != 0;   // includes '\0'
+
+  jobs = 0;
+  if(argc > 2 && strcmp(argv[1], "-j") == 0){
+    jobs = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+    if(jobs <= 0){
+      fprintf(2, "usage: wc [-j jobs] [file ...]\n");
+      exit(1);
+    }
+  }
 
   if(argc <= 1){
-    wc(0, "");
+    wc(stdin, &n);
+    report(&n, "");
+    exit(0);
+  }
+
+  if(jobs == 0)
+    jobs = ncpu();
+  if(jobs > NCPU)
+    jobs = NCPU;
+  if(jobs > argc - 1)
+    jobs = argc - 1;
+  if(jobs > 1){
+    parallel(argv + 1, argc - 1, jobs);
     exit(0);
   }
 
   for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], O_RDONLY)) < 0){
-      printf("wc: cannot open %s\n", argv[i]);
-      exit(1);
-    }
-    wc(fd, argv[i]);
-    close(fd);
+    wcfile(argv[i], &n);
+    report(&n, argv[i]);
   }
   exit(0);
 }
@@ -0,0 +1,163 @@
+// Measure wc: its counting loop, on several MB piped to it,
+// and counting files one at a time versus in parallel.
+// Files are limited to 268 KB, so the parallel runs name
+// each of a few generated files several times.
+//
+// usage: wcbench [mbytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define CHUNK  (64*1024)
+#define NFILE  4
+#define REPEAT 6    // times each file is named; MAXARG limits argv
+
+char text[CHUNK];
+char names[NFILE][8];
+
+// fill text with lines of random lowercase words.
+void
+gentext(void)
+{
+  uint seed = 1;
+  int i, col;
+
+  col = 0;
+  for(i = 0; i < CHUNK; i++){
+    seed = seed * 1103515245 + 12345;
+    if(col > 20 && (seed >> 16) % 16 == 0){
+      text[i] = '\n';
+      col = 0;
+    } else if((seed >> 16) % 6 == 0){
+      text[i] = ' ';
+      col++;
+    } else {
+      text[i] = 'a' + (seed >> 16) % 26;
+      col++;
+    }
+  }
+  text[CHUNK-1] = '\n';
+}
+
+// drain wc's output from fd, so that it does not
+// go to the console.
+void
+drain(int fd)
+{
+  char b[128];
+
+  while(read(fd, b, sizeof(b)) > 0)
+    ;
+  close(fd);
+}
+
+// pipe mb MB through wc. returns elapsed ticks.
+int
+piped(int mb)
+{
+  char *argv[] = { "wc", 0 };
+  int p[2], q[2], fds[3], i, t0;
+
+  if(pipe(p) < 0 || pipe(q) < 0){
+    fprintf(2, "wcbench: pipe failed\n");
+    exit(1);
+  }
+  fds[0] = p[0];
+  fds[1] = q[1];
+  fds[2] = 2;
+  t0 = uptime();
+  if(spawn("wc", argv, fds, 3) < 0){
+    fprintf(2, "wcbench: cannot run wc\n");
+    exit(1);
+  }
+  close(p[0]);
+  close(q[1]);
+  for(i = 0; i < mb * (1024*1024 / CHUNK); i++)
+    write(p[1], text, CHUNK);
+  close(p[1]);
+  drain(q[0]);
+  wait(0);
+  return uptime() - t0;
+}
+
+// run wc -j jobs over every file REPEAT times.
+// returns elapsed ticks.
+int
+files(int jobs)
+{
+  char *argv[3 + NFILE*REPEAT + 1], j[8];
+  int q[2], fds[3], i, t0;
+
+  j[0] = '0' + jobs;
+  j[1] = 0;
+  argv[0] = "wc";
+  argv[1] = "-j";
+  argv[2] = j;
+  for(i = 0; i < NFILE*REPEAT; i++)
+    argv[3 + i] = names[i % NFILE];
+  argv[3 + i] = 0;
+
+  if(pipe(q) < 0){
+    fprintf(2, "wcbench: pipe failed\n");
+    exit(1);
+  }
+  fds[0] = 0;
+  fds[1] = q[1];
+  fds[2] = 2;
+  t0 = uptime();
+  if(spawn("wc", argv, fds, 3) < 0){
+    fprintf(2, "wcbench: cannot run wc\n");
+    exit(1);
+  }
+  close(q[1]);
+  drain(q[0]);
+  wait(0);
+  return uptime() - t0;
+}
+
+void
+report(char *what, int kb, int t)
+{
+  printf("wcbench: %s: %d KB in %d ticks", what, kb, t);
+  if(t > 0)
+    printf(", %d KB/tick", kb / t);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, mb = 8;
+
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(mb <= 0){
+    fprintf(2, "usage: wcbench [mbytes]\n");
+    exit(1);
+  }
+  gentext();
+  report("pipe", mb * 1024, piped(mb));
+
+  for(i = 0; i < NFILE; i++){
+    strcpy(names[i], "wcb.0");
+    names[i][4] = '0' + i;
+    if((fd = open(names[i], O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+       write(fd, text, CHUNK) != CHUNK){
+      fprintf(2, "wcbench: cannot create %s\n", names[i]);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 1; i <= NFILE; i *= 2){
+    char what[16];
+    strcpy(what, "files -j ");
+    what[9] = '0' + i;
+    what[10] = 0;
+    report(what, NFILE * REPEAT * CHUNK / 1024, files(i));
+  }
+  for(i = 0; i < NFILE; i++)
+    unlink(names[i]);
+  exit(0);
+}